@@ -14,12 +14,12 @@ when the countdown reaches zero or gets negative.
 #include "countdown.h"
 
 struct Countdown {
-    atomic_int n;
+    atomic_long n;
     pthread_mutex_t mutex;
     pthread_cond_t cond;
 };
 
-Countdown* countdown_new(int n) {
+Countdown* countdown_new(long int n) {
     require("not negative", n >= 0);
     Countdown* c = xmalloc(sizeof(Countdown));
     atomic_store(&c->n, n);
@@ -30,9 +30,9 @@ Countdown* countdown_new(int n) {
     return c;
 }
 
-void countdown_add(Countdown* c, int i) {
+void countdown_add(Countdown* c, long int i) {
     require_not_null(c);
-    int n = atomic_fetch_add(&c->n, i);
+    long int n = atomic_fetch_add(&c->n, i);
     if (n + i <= 0) {
         int error = pthread_cond_broadcast(&c->cond);
         panic_if(error != 0, "error %d", error);
@@ -41,16 +41,16 @@ void countdown_add(Countdown* c, int i) {
 
 void countdown_inc(Countdown* c) {
     require_not_null(c);
-    int n = atomic_fetch_add(&c->n, 1);
+    long int n = atomic_fetch_add(&c->n, 1);
     if (n + 1 <= 0) {
         int error = pthread_cond_broadcast(&c->cond);
         panic_if(error != 0, "error %d", error);
     }
 }
 
-void countdown_sub(Countdown* c, int i) {
+void countdown_sub(Countdown* c, long int i) {
     require_not_null(c);
-    int n = atomic_fetch_sub(&c->n, i);
+    long int n = atomic_fetch_sub(&c->n, i);
     if (n - i <= 0) {
         int error = pthread_cond_broadcast(&c->cond);
         panic_if(error != 0, "error %d", error);
@@ -59,7 +59,7 @@ void countdown_sub(Countdown* c, int i) {
 
 void countdown_dec(Countdown* c) {
     require_not_null(c);
-    int n = atomic_fetch_sub(&c->n, 1);
+    long int n = atomic_fetch_sub(&c->n, 1);
     if (n - 1 <= 0) {
         int error = pthread_cond_broadcast(&c->cond);
         panic_if(error != 0, "error %d", error);
@@ -92,7 +92,7 @@ void countdown_free(Countdown* c) {
     free(c);
 }
 
-void countdown_set(Countdown* c, int i) {
+void countdown_set(Countdown* c, long int i) {
     require_not_null(c);
     atomic_store(&c->n, i);
     if (i <= 0) {
@@ -101,7 +101,7 @@ void countdown_set(Countdown* c, int i) {
     }
 }
 
-int countdown_get(Countdown* c) {
+long int countdown_get(Countdown* c) {
     require_not_null(c);
     return atomic_load(&c->n);
 }
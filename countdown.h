@@ -10,15 +10,15 @@
 
 typedef struct Countdown Countdown;
 
-Countdown* countdown_new(int n);
-void countdown_add(Countdown* c, int i);
-void countdown_sub(Countdown* c, int i);
+Countdown* countdown_new(long int n);
+void countdown_add(Countdown* c, long int i);
+void countdown_sub(Countdown* c, long int i);
 void countdown_inc(Countdown* c);
 void countdown_dec(Countdown* c);
 void countdown_wait(Countdown* c);
 void countdown_free(Countdown* c);
-void countdown_set(Countdown* c, int i);
-int countdown_get(Countdown* c);
+void countdown_set(Countdown* c, long int i);
+long int countdown_get(Countdown* c);
 bool countdown_finished(Countdown* c);
 
 #endif // countdown_h_INCLUDED
@@ -0,0 +1,392 @@
+/*
+External parallel sort for binary files of native ints that do not fit into main
+memory. The sort has two phases.
+
+The first phase cuts the file into chunks that fit into the memory budget, sorts
+each chunk with psort_int, and writes it to a temporary run file. Reading,
+sorting, and writing are a pipeline of three threads connected by channels: The
+reader takes an empty buffer from the free channel, fills it with one large read,
+and sends it to the sort channel. The calling thread sorts it with all threads
+and sends it to the write channel. The writer writes the run and returns the
+buffer to the free channel. With three buffers, the next chunk is read and the
+previous run is written while a chunk is sorted. A fourth share of the budget is
+left for the scratch buffer of the radix sort. A file that fits into memory
+as a whole is sorted in place and written directly to the output.
+
+The second phase merges the runs with a k-way merge. Each run has two
+read-ahead blocks. When the merge has consumed a block, the block goes back to a
+reader thread through the request channel and is refilled with the next part of
+the run, while the merge continues with the other block of the run. The reader
+serves the requests in order, so the blocks of a run arrive in order on the
+run's ready channel. The output is written behind in the same way: the merge
+fills one of two output blocks while a writer thread writes the other. The next
+element is taken from a binary heap of the runs, ordered by their current
+element. All 2k + 2 blocks share the memory budget. If that would make the
+blocks smaller than min_block bytes, groups of runs are merged into longer runs
+first, in as many passes as necessary.
+
+The run files are unlinked right after they are created, so they disappear when
+they are closed, even if the program is aborted. I/O errors are fatal.
+
+@author: Michael Rohs
+@date: October 17, 2026
+*/
+
+#if 0
+#define NO_ASSERT
+#define NO_REQUIRE
+#define NO_ENSURE
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "extsort.h"
+#include "psort.h"
+#include "uchan.h"
+
+// Returns the default options: 1 GB of memory, one thread per CPU, and $TMPDIR
+// or /tmp for the run files.
+ExtSortOptions extsort_options(void) {
+    const char* tmp_dir = getenv("TMPDIR");
+    return (ExtSortOptions){
+        .memory = (size_t)1 << 30,
+        .n_threads = psort_options().n_threads,
+        .tmp_dir = tmp_dir != NULL && *tmp_dir != '\0' ? tmp_dir : "/tmp",
+        .min_block = (size_t)1 << 20,
+    };
+}
+
+// Reads n bytes at offset from fd into buf. Panics if fewer bytes are available.
+static void read_fully(int fd, void* buf, size_t n, off_t offset) {
+    char* p = buf;
+    size_t done = 0;
+    while (done < n) {
+        ssize_t r = pread(fd, p + done, n - done, offset + (off_t)done);
+        if (r < 0 && errno == EINTR) continue;
+        panic_if(r < 0, "read failed: %s", strerror(errno));
+        panic_if(r == 0, "unexpected end of file");
+        done += (size_t)r;
+    }
+}
+
+// Writes the n bytes of buf to fd.
+static void write_fully(int fd, const void* buf, size_t n) {
+    const char* p = buf;
+    size_t done = 0;
+    while (done < n) {
+        ssize_t r = write(fd, p + done, n - done);
+        if (r < 0 && errno == EINTR) continue;
+        panic_if(r < 0, "write failed: %s", strerror(errno));
+        done += (size_t)r;
+    }
+}
+
+// Creates an anonymous temporary file in dir and returns its descriptor.
+static int new_run_file(const char* dir) {
+    char path[4096];
+    int len = snprintf(path, sizeof(path), "%s/extsort-XXXXXX", dir);
+    panic_if(len < 0 || len >= (int)sizeof(path), "directory name too long: %s", dir);
+    int fd = mkstemp(path);
+    panic_if(fd < 0, "cannot create run file in %s: %s", dir, strerror(errno));
+    unlink(path);
+    return fd;
+}
+
+// A sorted run in a file.
+typedef struct {
+    int fd;
+    long int n; // number of ints
+} Run;
+
+// A buffer of the run formation.
+typedef struct {
+    int* data;
+    long int n; // number of ints
+} Chunk;
+
+typedef struct {
+    int in_fd;
+    long int n_elements;
+    long int chunk_cap; // ints per chunk
+    UChan* ch_free;
+    UChan* ch_filled;
+    UChan* ch_sorted;
+    int out_fd; // the output file if there is a single chunk, -1 otherwise
+    const char* tmp_dir;
+    Run* runs;
+    long int n_runs;
+} RunFormation;
+
+static void* read_chunks(void* arg) {
+    RunFormation* rf = arg;
+    for (long int begin = 0; begin < rf->n_elements; begin += rf->chunk_cap) {
+        Chunk* c = uchan_receive(rf->ch_free);
+        c->n = rf->n_elements - begin < rf->chunk_cap ? rf->n_elements - begin : rf->chunk_cap;
+        read_fully(rf->in_fd, c->data, c->n * sizeof(int), (off_t)begin * sizeof(int));
+        uchan_send(rf->ch_filled, c);
+    }
+    uchan_close(rf->ch_filled);
+    return NULL;
+}
+
+static void* write_chunks(void* arg) {
+    RunFormation* rf = arg;
+    Chunk* c;
+    while (uchan_receive2(rf->ch_sorted, (void**)&c)) {
+        int fd = rf->out_fd >= 0 ? rf->out_fd : new_run_file(rf->tmp_dir);
+        write_fully(fd, c->data, c->n * sizeof(int));
+        if (rf->out_fd < 0) rf->runs[rf->n_runs++] = (Run){fd, c->n};
+        uchan_send(rf->ch_free, c);
+    }
+    return NULL;
+}
+
+// Sorts the chunks of the input file and writes them to run files, or directly
+// to out_fd if the input fits into memory. Returns the runs.
+static Run* form_runs(int in_fd, long int n_elements, int out_fd, const ExtSortOptions* opts, long int* n_runs) {
+    RunFormation rf = {.in_fd = in_fd, .n_elements = n_elements, .out_fd = -1, .tmp_dir = opts->tmp_dir};
+    int n_chunks = 3;
+    // data and sort scratch, or three buffers in the pipeline and the scratch
+    if (2 * n_elements * sizeof(int) <= opts->memory) {
+        rf.chunk_cap = n_elements;
+        rf.out_fd = out_fd;
+        n_chunks = 1;
+    } else {
+        rf.chunk_cap = opts->memory / 4 / sizeof(int);
+    }
+    long int n_total = (n_elements + rf.chunk_cap - 1) / rf.chunk_cap;
+    if (n_total < n_chunks) n_chunks = (int)n_total;
+    rf.runs = xmalloc(n_total * sizeof(Run));
+    rf.ch_free = uchan_new();
+    rf.ch_filled = uchan_new();
+    rf.ch_sorted = uchan_new();
+    int* buffer = xmalloc(n_chunks * rf.chunk_cap * sizeof(int));
+    Chunk chunks[3];
+    for (int i = 0; i < n_chunks; i++) {
+        chunks[i] = (Chunk){buffer + i * rf.chunk_cap, 0};
+        uchan_send(rf.ch_free, &chunks[i]);
+    }
+    pthread_t reader, writer;
+    int error = pthread_create(&reader, NULL, read_chunks, &rf);
+    panic_if(error != 0, "error %d", error);
+    error = pthread_create(&writer, NULL, write_chunks, &rf);
+    panic_if(error != 0, "error %d", error);
+
+    PSortOptions sort_opts = psort_options();
+    sort_opts.n_threads = opts->n_threads;
+    Chunk* c;
+    while (uchan_receive2(rf.ch_filled, (void**)&c)) {
+        psort_int(c->data, c->n, &sort_opts);
+        uchan_send(rf.ch_sorted, c);
+    }
+    uchan_close(rf.ch_sorted);
+
+    error = pthread_join(reader, NULL);
+    panic_if(error != 0, "error %d", error);
+    error = pthread_join(writer, NULL);
+    panic_if(error != 0, "error %d", error);
+    uchan_free(rf.ch_sorted);
+    uchan_free(rf.ch_filled);
+    uchan_free(rf.ch_free);
+    free(buffer);
+    *n_runs = rf.n_runs;
+    return rf.runs;
+}
+
+// A read-ahead block of a run, or an output block.
+typedef struct {
+    int* data;
+    long int n; // number of ints, 0 if the run is exhausted
+    long int pos; // next int to merge
+    int run; // index of the run
+} Block;
+
+typedef struct {
+    Run* runs;
+    long int* offsets; // next int to read from each run
+    long int block_cap; // ints per block
+    UChan* ch_requests; // blocks to refill
+    UChan** ch_ready; // filled blocks of each run, in run order
+    int out_fd;
+    UChan* ch_out_free;
+    UChan* ch_out_full;
+} Merge;
+
+static void* read_blocks(void* arg) {
+    Merge* m = arg;
+    Block* b;
+    while (uchan_receive2(m->ch_requests, (void**)&b)) {
+        long int offset = m->offsets[b->run];
+        long int n = m->runs[b->run].n - offset;
+        if (n > m->block_cap) n = m->block_cap;
+        read_fully(m->runs[b->run].fd, b->data, n * sizeof(int), (off_t)offset * sizeof(int));
+        m->offsets[b->run] += n;
+        b->n = n;
+        b->pos = 0;
+        uchan_send(m->ch_ready[b->run], b);
+    }
+    return NULL;
+}
+
+static void* write_blocks(void* arg) {
+    Merge* m = arg;
+    Block* b;
+    while (uchan_receive2(m->ch_out_full, (void**)&b)) {
+        write_fully(m->out_fd, b->data, b->n * sizeof(int));
+        uchan_send(m->ch_out_free, b);
+    }
+    return NULL;
+}
+
+// Current element of run r in the merge.
+#define HEAD(current, r) ((current)[r]->data[(current)[r]->pos])
+
+// Restores the heap order of the run indices in heap below position i.
+static void sift_down(int* heap, int i, int n, Block** current) {
+    int r = heap[i];
+    while (true) {
+        int c = 2 * i + 1;
+        if (c >= n) break;
+        if (c + 1 < n && HEAD(current, heap[c + 1]) < HEAD(current, heap[c])) c++;
+        if (HEAD(current, r) <= HEAD(current, heap[c])) break;
+        heap[i] = heap[c];
+        i = c;
+    }
+    heap[i] = r;
+}
+
+// Merges the k runs into out_fd with 2k + 2 blocks that share memory bytes.
+static void merge_runs(Run* runs, int k, int out_fd, size_t memory) {
+    require("valid run count", k > 0);
+    Merge m = {.runs = runs, .out_fd = out_fd};
+    m.block_cap = memory / (2 * k + 2) / sizeof(int);
+    m.offsets = xcalloc(k, sizeof(long int));
+    m.ch_requests = uchan_new();
+    m.ch_ready = xmalloc(k * sizeof(UChan*));
+    m.ch_out_free = uchan_new();
+    m.ch_out_full = uchan_new();
+    int* buffer = xmalloc((2 * k + 2) * m.block_cap * sizeof(int));
+    Block* blocks = xmalloc((2 * k + 2) * sizeof(Block));
+    for (int i = 0; i < 2 * k + 2; i++) {
+        blocks[i] = (Block){buffer + i * m.block_cap, 0, 0, i / 2};
+    }
+    void** requests = xmalloc((2 * k + 2) * sizeof(void*));
+    for (int i = 0; i < 2 * k + 2; i++) requests[i] = &blocks[i];
+    for (int r = 0; r < k; r++) m.ch_ready[r] = uchan_new();
+    uchan_send_n(m.ch_requests, requests, 2 * k);
+    uchan_send_n(m.ch_out_free, requests + 2 * k, 2);
+    free(requests);
+    pthread_t reader, writer;
+    int error = pthread_create(&reader, NULL, read_blocks, &m);
+    panic_if(error != 0, "error %d", error);
+    error = pthread_create(&writer, NULL, write_blocks, &m);
+    panic_if(error != 0, "error %d", error);
+
+    Block** current = xmalloc(k * sizeof(Block*));
+    int* heap = xmalloc(k * sizeof(int));
+    int n_heap = 0;
+    for (int r = 0; r < k; r++) {
+        current[r] = uchan_receive(m.ch_ready[r]);
+        if (current[r]->n > 0) heap[n_heap++] = r;
+    }
+    for (int i = n_heap / 2 - 1; i >= 0; i--) sift_down(heap, i, n_heap, current);
+    Block* out = uchan_receive(m.ch_out_free);
+    out->n = 0;
+    while (n_heap > 0) {
+        int r = heap[0];
+        Block* b = current[r];
+        out->data[out->n++] = b->data[b->pos++];
+        if (out->n == m.block_cap) {
+            uchan_send(m.ch_out_full, out);
+            out = uchan_receive(m.ch_out_free);
+            out->n = 0;
+        }
+        if (b->pos == b->n) {
+            // refill this block and continue with the other block of the run
+            uchan_send(m.ch_requests, b);
+            current[r] = uchan_receive(m.ch_ready[r]);
+            if (current[r]->n == 0) heap[0] = heap[--n_heap];
+        }
+        if (n_heap > 0) sift_down(heap, 0, n_heap, current);
+    }
+    if (out->n > 0) uchan_send(m.ch_out_full, out);
+    uchan_close(m.ch_out_full);
+    uchan_close(m.ch_requests);
+    error = pthread_join(writer, NULL);
+    panic_if(error != 0, "error %d", error);
+    error = pthread_join(reader, NULL);
+    panic_if(error != 0, "error %d", error);
+
+    for (int r = 0; r < k; r++) uchan_free(m.ch_ready[r]);
+    uchan_free(m.ch_out_full);
+    uchan_free(m.ch_out_free);
+    uchan_free(m.ch_requests);
+    free(heap);
+    free(current);
+    free(blocks);
+    free(buffer);
+    free(m.ch_ready);
+    free(m.offsets);
+}
+
+// Sorts the file at in_path, which consists of native ints, into out_path. The
+// two paths must not refer to the same file. Buffers are limited to opts->memory bytes, which must
+// hold at least six blocks of opts->min_block bytes.
+ExtSortStats extsort_int_file(const char* in_path, const char* out_path, const ExtSortOptions* opts) {
+    require_not_null(in_path);
+    require_not_null(out_path);
+    ExtSortOptions o = opts != NULL ? *opts : extsort_options();
+    require("positive", o.n_threads > 0);
+    require("valid block size", o.min_block >= sizeof(int));
+    require("enough memory", o.memory >= 6 * o.min_block);
+
+    int in_fd = open(in_path, O_RDONLY);
+    panic_if(in_fd < 0, "cannot open %s: %s", in_path, strerror(errno));
+    struct stat st;
+    panic_if(fstat(in_fd, &st) != 0, "cannot stat %s: %s", in_path, strerror(errno));
+    panic_if(st.st_size % sizeof(int) != 0, "size of %s is not a multiple of %zu", in_path, sizeof(int));
+    // opening the output truncates it, so it must not be the input under
+    // another name (a hard link or a symbolic link)
+    struct stat out_st;
+    panic_if(stat(out_path, &out_st) == 0 && out_st.st_dev == st.st_dev && out_st.st_ino == st.st_ino,
+             "%s and %s are the same file", in_path, out_path);
+    int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    panic_if(out_fd < 0, "cannot open %s: %s", out_path, strerror(errno));
+
+    ExtSortStats stats = {.n_elements = (long int)(st.st_size / sizeof(int))};
+    if (stats.n_elements > 0) {
+        long int n_runs;
+        Run* runs = form_runs(in_fd, stats.n_elements, out_fd, &o, &n_runs);
+        stats.n_runs = n_runs > 0 ? n_runs : 1;
+        // each run and the output need two blocks of at least min_block bytes
+        long int fan_in = (long int)(o.memory / (2 * o.min_block)) - 1;
+        while (n_runs > 0) {
+            stats.n_merge_passes++;
+            if (n_runs <= fan_in) {
+                merge_runs(runs, (int)n_runs, out_fd, o.memory);
+                for (long int r = 0; r < n_runs; r++) close(runs[r].fd);
+                break;
+            }
+            long int n_merged = 0;
+            for (long int i = 0; i < n_runs; i += fan_in) {
+                int k = n_runs - i < fan_in ? (int)(n_runs - i) : (int)fan_in;
+                Run merged = runs[i];
+                if (k > 1) {
+                    merged.fd = new_run_file(o.tmp_dir);
+                    merged.n = 0;
+                    for (int r = 0; r < k; r++) merged.n += runs[i + r].n;
+                    merge_runs(runs + i, k, merged.fd, o.memory);
+                    for (int r = 0; r < k; r++) close(runs[i + r].fd);
+                }
+                runs[n_merged++] = merged;
+            }
+            n_runs = n_merged;
+        }
+        free(runs);
+    }
+    panic_if(close(out_fd) != 0, "cannot close %s: %s", out_path, strerror(errno));
+    close(in_fd);
+    return stats;
+}
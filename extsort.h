@@ -0,0 +1,31 @@
+/*
+@author: Michael Rohs
+@date: October 17, 2026
+*/
+
+#ifndef extsort_h_INCLUDED
+#define extsort_h_INCLUDED
+
+#include "util.h"
+
+// Configures an external sort. A NULL options pointer means extsort_options().
+typedef struct ExtSortOptions ExtSortOptions;
+struct ExtSortOptions {
+    size_t memory; // bytes for all buffers together, including the sort's scratch
+    int n_threads; // number of threads for sorting the runs
+    const char* tmp_dir; // directory for the run files
+    size_t min_block; // smallest read-ahead block of the merge in bytes
+};
+
+// Statistics of an external sort.
+typedef struct ExtSortStats ExtSortStats;
+struct ExtSortStats {
+    long int n_elements; // number of ints in the file
+    long int n_runs; // number of sorted runs that the first phase produced
+    int n_merge_passes; // number of merge passes, 0 if the file fit into memory
+};
+
+ExtSortOptions extsort_options(void);
+ExtSortStats extsort_int_file(const char* in_path, const char* out_path, const ExtSortOptions* opts);
+
+#endif // extsort_h_INCLUDED
@@ -0,0 +1,94 @@
+#include <unistd.h>
+#include "extsort.h"
+
+int compare_int(const void* x, const void* y) {
+    int a = *(const int*)x, b = *(const int*)y;
+    return (a > b) - (a < b);
+}
+
+// Writes n random ints to the file at path and returns them, or NULL if not
+// keep.
+int* write_random_file(const char* path, long int n, bool keep) {
+    FILE* f = fopen(path, "wb");
+    panic_if(f == NULL, "cannot open %s", path);
+    int* a = xmalloc((n + 1) * sizeof(int));
+    long int block = 1 << 20;
+    for (long int i = 0; i < n; i += block) {
+        long int m = n - i < block ? n - i : block;
+        for (long int j = 0; j < m; j++) a[keep ? i + j : j] = i_rnd(1 << 30) - (1 << 29);
+        panic_if(fwrite(a + (keep ? i : 0), sizeof(int), m, f) != m, "cannot write %s", path);
+    }
+    fclose(f);
+    if (keep) return a;
+    free(a);
+    return NULL;
+}
+
+// Returns whether the file at path contains the n ints of expected.
+bool file_equals(const char* path, const int* expected, long int n) {
+    FILE* f = fopen(path, "rb");
+    panic_if(f == NULL, "cannot open %s", path);
+    int* a = xmalloc((n + 1) * sizeof(int));
+    long int n_read = fread(a, sizeof(int), n + 1, f);
+    fclose(f);
+    bool ok = n_read == n && memcmp(a, expected, n * sizeof(int)) == 0;
+    free(a);
+    return ok;
+}
+
+// Sorts a file of n ints with the given memory budget and checks the output and
+// the number of merge passes.
+void test_extsort(long int n, size_t memory, int expected_passes) {
+    char in_path[] = "/tmp/extsort_test_in_XXXXXX";
+    char out_path[] = "/tmp/extsort_test_out_XXXXXX";
+    int fd = mkstemp(in_path);
+    close(fd);
+    fd = mkstemp(out_path);
+    close(fd);
+    int* a = write_random_file(in_path, n, true);
+    ExtSortOptions opts = extsort_options();
+    opts.memory = memory;
+    opts.min_block = 4096;
+    opts.n_threads = 3;
+    ExtSortStats stats = extsort_int_file(in_path, out_path, &opts);
+    qsort(a, n, sizeof(int), compare_int);
+    test_equal_i(file_equals(out_path, a, n), true);
+    test_equal_i(stats.n_merge_passes, expected_passes);
+    test_equal_i(stats.n_elements == n, true);
+    unlink(in_path);
+    unlink(out_path);
+    free(a);
+}
+
+// Without arguments, runs the tests. Otherwise generates a file of random ints
+// or sorts a file with the given memory budget in MB:
+//
+//     extsort_test gen file n
+//     extsort_test sort in_file out_file [memory_mb [threads]]
+int main(int argc, char* argv[]) {
+    if (argc >= 4 && strcmp(argv[1], "gen") == 0) {
+        long int n = atol(argv[3]);
+        exit_if(n < 0, "usage: extsort_test gen file n");
+        write_random_file(argv[2], n, false);
+        return 0;
+    }
+    if (argc >= 4 && strcmp(argv[1], "sort") == 0) {
+        ExtSortOptions opts = extsort_options();
+        if (argc >= 5) opts.memory = (size_t)atol(argv[4]) << 20;
+        if (argc >= 6) opts.n_threads = atoi(argv[5]);
+        exit_if(opts.memory < 6 * opts.min_block || opts.n_threads <= 0,
+                "usage: extsort_test sort in_file out_file [memory_mb (at least 6) [threads]]");
+        timespec start = time_now();
+        ExtSortStats stats = extsort_int_file(argv[2], argv[3], &opts);
+        printf("n = %ld, runs = %ld, merge passes = %d, time = %.1f ms\n",
+               stats.n_elements, stats.n_runs, stats.n_merge_passes, time_ms_since(start));
+        return 0;
+    }
+    test_extsort(0, 1 << 20, 0);
+    test_extsort(1000, 1 << 20, 0);
+    // 13 runs of 16K ints, merged in one pass
+    test_extsort(200000, 1 << 18, 1);
+    // 66 runs of 3K ints with a fan-in of 5: 66 -> 14 -> 3 -> 1
+    test_extsort(200000, 48 << 10, 3);
+    return 0;
+}
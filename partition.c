@@ -0,0 +1,430 @@
+/*
+Partitioning of int arrays around a pivot element. The pivot is the median of
+three elements (first, middle, last) for medium-sized slices and Tukey's ninther
+(the median of three medians of three) for large slices. Unlike a random pivot
+this needs no call to rand() and gives better splits. It can be defeated by
+crafted inputs, so callers should bound the number of unbalanced splits (see
+psort.h). partition is the scalar Hoare-style reference implementation.
+partition_simd does the same, but uses a vectorized kernel that is selected at
+runtime according to the capabilities of the CPU: AVX-512 (vector compare plus
+compress), AVX2 (vector compare plus permutation table), or the scalar version
+as a fallback.
+
+The vectorized kernels work in-place as described by Bramas [Bramas 2017]: The
+first and the last vector of the range are loaded into registers, which creates
+free space at both ends of the range. Then vectors are repeatedly loaded from
+the side that has less free space left. The elements of each vector are
+compared with the pivot and permuted such that the elements <= p come first.
+The vector is then stored twice, once at the left write position (of which the
+elements <= p are kept) and once at the right write position (of which the
+elements > p are kept). The loop has no data-dependent branches. The few
+remaining elements and the two saved vectors are placed by scalar code.
+
+Where SIMD is not available, partition_branchless avoids the branch
+mispredictions of the scalar loop as described by Edelkamp and Weiß [Edelkamp
+2016]: A block of B elements at each end of the range is scanned, and the
+offsets of the elements that are on the wrong side are stored in a small
+buffer. The comparison result is added to the buffer index rather than tested
+in a branch. Then misplaced elements from both buffers are swapped in bulk.
+
+Partitioning schemes can be selected at runtime by name via partition_scheme.
+
+Keys equal to the pivot all end up in the lower part. Callers that need a fat
+pivot partition the lower part again (see psort.h).
+
+[Bramas 2017]: B. Bramas, A Novel Hybrid Quicksort Algorithm Vectorized using
+AVX-512 on Intel Skylake, IJACSA 8(10), 2017
+[Edelkamp 2016]: S. Edelkamp, A. Weiß, BlockQuicksort: Avoiding Branch
+Mispredictions in Quicksort, ESA 2016
+
+@author: Michael Rohs
+@date: October 17, 2026
+*/
+
+#if 0
+#define NO_ASSERT
+#define NO_REQUIRE
+#define NO_ENSURE
+#endif
+
+#include <pthread.h>
+#include "partition.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PARTITION_X86
+#include <immintrin.h>
+#endif
+
+// Slices with at least this many elements use the ninther as the pivot.
+#define NINTHER_SIZE 128
+
+// Returns the index of the median of a[i], a[j], and a[k].
+static int median3(int* a, int i, int j, int k) {
+    if (a[i] < a[j]) {
+        if (a[j] < a[k]) return j;
+        return a[i] < a[k] ? k : i;
+    } else {
+        if (a[i] < a[k]) return i;
+        return a[j] < a[k] ? k : j;
+    }
+}
+
+// Returns the index of the pivot element for the slice of array a denoted by
+// index interval [low, high] (bounds inclusive): the median of three for medium
+// slices and Tukey's ninther for large slices.
+static int partition_pivot_index(int* a, int low, int high) {
+    require_not_null(a);
+    require("valid bounds", 0 <= low && low <= high);
+    int n = high - low + 1;
+    int mid = low + n / 2;
+    if (n < 3) return low;
+    if (n < NINTHER_SIZE) return median3(a, low, mid, high);
+    int s = n / 8;
+    int m1 = median3(a, low, low + s, low + 2 * s);
+    int m2 = median3(a, mid - s, mid, mid + s);
+    int m3 = median3(a, high - 2 * s, high - s, high);
+    return median3(a, m1, m2, m3);
+}
+
+// Partitions the slice of array a denoted by index interval [low, high] (bounds
+// inclusive) using pivot element p that is picked by partition_pivot_index, such that the
+// resulting slice has the form {...<=p..., p, ...>p...}.
+// Returns the index of the pivot element.
+int partition(int* a, int low, int high) {
+    require_not_null(a);
+    require("valid bounds", 0 <= low && low <= high);
+    if (low == high) return low;
+    assert("", low < high);
+    int pi = partition_pivot_index(a, low, high);
+    int p = a[pi];
+    a[pi] = a[low];
+    a[low] = p;
+    int i = low + 1, j = high;
+    assert("", i <= j);
+    while (i <= j) {
+        assert("lower part <= p", forall_x(int k = low, k < i, k++, a[k] <= p));
+        assert("upper part > p", forall_x(int k = j + 1, k <= high, k++, a[k] > p));
+        while (i <= j && a[i] <= p) i++;
+        assert("", i > j || a[i] > p); 
+        if (i > j) break;
+        assert("", a[i] > p); 
+        while (i <= j && a[j] > p) j--;
+        assert("", a[i] > p && (i > j || a[j] <= p));
+        if (i > j) break;
+        assert("", i < j && a[i] > p && a[j] <= p);
+        int h = a[i];
+        a[i] = a[j];
+        a[j] = h;
+        assert("", i < j && a[i] <= p && a[j] > p);
+        i++; j--;
+    }
+    assert("", i == j + 1);
+    assert("lower part <= p", forall_x(int k = low, k <= j, k++, a[k] <= p));
+    assert("upper part > p", forall_x(int k = j + 1, k <= high, k++, a[k] > p));
+    int h = a[j];
+    a[j] = p;
+    a[low] = h;
+    ensure("lower part <= p", forall_x(int k = low, k <= j, k++, a[k] <= p));
+    ensure("upper part > p", forall_x(int k = j + 1, k <= high, k++, a[k] > p));
+    return j;
+}
+
+// Partitions the slice of array a denoted by index range [begin, end) (end
+// exclusive) around the given pivot value p, such that the resulting slice has
+// the form {...<=p..., ...>p...}. Returns the index of the first element > p
+// (end if there is none).
+int partition_range(int* a, int begin, int end, int p) {
+    require_not_null(a);
+    require("valid bounds", 0 <= begin && begin <= end);
+    int i = begin, j = end - 1;
+    while (true) {
+        while (i <= j && a[i] <= p) i++;
+        while (i <= j && a[j] > p) j--;
+        if (i > j) break;
+        int h = a[i];
+        a[i] = a[j];
+        a[j] = h;
+        i++; j--;
+    }
+    ensure("lower part <= p", forall_x(int k = begin, k < i, k++, a[k] <= p));
+    ensure("upper part > p", forall_x(int k = i, k < end, k++, a[k] > p));
+    return i;
+}
+
+// Places the elements of the buffer (which are no longer in the range) into the
+// free space [*left_w, *right_w) of a. The free space must have exactly n
+// elements.
+static void place_scalar(int* a, int* buffer, int n, int p, int* left_w, int* right_w) {
+    require("buffer fills free space", *right_w - *left_w == n);
+    for (int k = 0; k < n; k++) {
+        int x = buffer[k];
+        if (x <= p) {
+            a[(*left_w)++] = x;
+        } else {
+            a[--(*right_w)] = x;
+        }
+    }
+    assert("free space filled", *left_w == *right_w);
+}
+
+#ifdef PARTITION_X86
+
+// For each 8-bit comparison mask, the permutation that moves the elements whose
+// mask bit is not set (<= p) to the front and those whose bit is set (> p) to
+// the back.
+static int perm_avx2[256][8];
+
+static void init_perm_avx2(void) {
+    for (int m = 0; m < 256; m++) {
+        int k = 0;
+        for (int i = 0; i < 8; i++) if (!(m & (1 << i))) perm_avx2[m][k++] = i;
+        for (int i = 0; i < 8; i++) if (m & (1 << i)) perm_avx2[m][k++] = i;
+    }
+}
+
+__attribute__((target("avx2,popcnt")))
+static int partition_range_avx2(int* a, int begin, int end, int p) {
+    require_not_null(a);
+    require("valid bounds", 0 <= begin && begin <= end);
+    const int V = 8;
+    if (end - begin < 2 * V) return partition_range(a, begin, end, p);
+    __m256i pv = _mm256_set1_epi32(p);
+    __m256i first = _mm256_loadu_si256((__m256i*)(a + begin));
+    __m256i last = _mm256_loadu_si256((__m256i*)(a + end - V));
+    int left_r = begin + V, right_r = end - V; // read positions
+    int left_w = begin, right_w = end; // write positions
+    while (right_r - left_r >= V) {
+        __m256i v;
+        if (left_r - left_w <= right_w - right_r) {
+            v = _mm256_loadu_si256((__m256i*)(a + left_r));
+            left_r += V;
+        } else {
+            right_r -= V;
+            v = _mm256_loadu_si256((__m256i*)(a + right_r));
+        }
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, pv)));
+        int n_gt = __builtin_popcount(mask);
+        __m256i perm = _mm256_loadu_si256((__m256i*)perm_avx2[mask]);
+        v = _mm256_permutevar8x32_epi32(v, perm);
+        _mm256_storeu_si256((__m256i*)(a + left_w), v);
+        _mm256_storeu_si256((__m256i*)(a + right_w - V), v);
+        left_w += V - n_gt;
+        right_w -= n_gt;
+    }
+    int buffer[3 * V];
+    int n = right_r - left_r;
+    memcpy(buffer, a + left_r, n * sizeof(int));
+    _mm256_storeu_si256((__m256i*)(buffer + n), first);
+    _mm256_storeu_si256((__m256i*)(buffer + n + V), last);
+    place_scalar(a, buffer, n + 2 * V, p, &left_w, &right_w);
+    ensure("lower part <= p", forall_x(int k = begin, k < left_w, k++, a[k] <= p));
+    ensure("upper part > p", forall_x(int k = left_w, k < end, k++, a[k] > p));
+    return left_w;
+}
+
+__attribute__((target("avx512f,popcnt")))
+static int partition_range_avx512(int* a, int begin, int end, int p) {
+    require_not_null(a);
+    require("valid bounds", 0 <= begin && begin <= end);
+    const int V = 16;
+    if (end - begin < 2 * V) return partition_range(a, begin, end, p);
+    __m512i pv = _mm512_set1_epi32(p);
+    __m512i first = _mm512_loadu_si512(a + begin);
+    __m512i last = _mm512_loadu_si512(a + end - V);
+    int left_r = begin + V, right_r = end - V; // read positions
+    int left_w = begin, right_w = end; // write positions
+    while (right_r - left_r >= V) {
+        __m512i v;
+        if (left_r - left_w <= right_w - right_r) {
+            v = _mm512_loadu_si512(a + left_r);
+            left_r += V;
+        } else {
+            right_r -= V;
+            v = _mm512_loadu_si512(a + right_r);
+        }
+        __mmask16 gt = _mm512_cmpgt_epi32_mask(v, pv);
+        int n_gt = __builtin_popcount(gt);
+        // compressing into a register and storing the full vector is faster
+        // than a masked compress-store on some CPUs
+        _mm512_storeu_si512(a + left_w, _mm512_maskz_compress_epi32(~gt, v));
+        _mm512_storeu_si512(a + right_w - V, _mm512_maskz_expand_epi32(
+            (__mmask16)(0xffff << (V - n_gt)), _mm512_maskz_compress_epi32(gt, v)));
+        left_w += V - n_gt;
+        right_w -= n_gt;
+    }
+    int buffer[3 * V];
+    int n = right_r - left_r;
+    memcpy(buffer, a + left_r, n * sizeof(int));
+    _mm512_storeu_si512(buffer + n, first);
+    _mm512_storeu_si512(buffer + n + V, last);
+    place_scalar(a, buffer, n + 2 * V, p, &left_w, &right_w);
+    ensure("lower part <= p", forall_x(int k = begin, k < left_w, k++, a[k] <= p));
+    ensure("upper part > p", forall_x(int k = left_w, k < end, k++, a[k] > p));
+    return left_w;
+}
+
+#endif // PARTITION_X86
+
+typedef int (*PartitionRangeFunc)(int* a, int begin, int end, int p);
+
+static pthread_once_t simd_once = PTHREAD_ONCE_INIT;
+static PartitionRangeFunc partition_range_selected = partition_range;
+static const char* simd_isa = "scalar";
+
+// Selects the best kernel that the CPU supports.
+static void init_simd(void) {
+#ifdef PARTITION_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        partition_range_selected = partition_range_avx512;
+        simd_isa = "avx512";
+    } else if (__builtin_cpu_supports("avx2")) {
+        init_perm_avx2();
+        partition_range_selected = partition_range_avx2;
+        simd_isa = "avx2";
+    }
+#endif
+}
+
+// Partitions the slice of array a denoted by index range [begin, end) (end
+// exclusive) like partition_range, but uses the vectorized kernel that is best
+// for this CPU.
+int partition_range_simd(int* a, int begin, int end, int p) {
+    int error = pthread_once(&simd_once, init_simd);
+    panic_if(error != 0, "error %d", error);
+    return partition_range_selected(a, begin, end, p);
+}
+
+// Moves the pivot element p to a[low], partitions the rest of the
+// slice [low, high] with the given range kernel, and moves p between the parts.
+// Returns the index of the pivot element.
+static int partition_with(PartitionRangeFunc partition_range_func, int* a, int low, int high) {
+    require_not_null(a);
+    require("valid bounds", 0 <= low && low <= high);
+    if (low == high) return low;
+    int pi = partition_pivot_index(a, low, high);
+    int p = a[pi];
+    a[pi] = a[low];
+    a[low] = p;
+    int j = partition_range_func(a, low + 1, high + 1, p) - 1;
+    a[low] = a[j];
+    a[j] = p;
+    ensure("lower part <= p", forall_x(int k = low, k <= j, k++, a[k] <= p));
+    ensure("upper part > p", forall_x(int k = j + 1, k <= high, k++, a[k] > p));
+    return j;
+}
+
+// Partitions the slice of array a denoted by index interval [low, high] (bounds
+// inclusive) like partition, but uses the vectorized kernel that is best for this
+// CPU. Returns the index of the pivot element.
+int partition_simd(int* a, int low, int high) {
+    return partition_with(partition_range_simd, a, low, high);
+}
+
+// Returns the name of the instruction set that partition_simd uses.
+const char* partition_simd_isa(void) {
+    int error = pthread_once(&simd_once, init_simd);
+    panic_if(error != 0, "error %d", error);
+    return simd_isa;
+}
+
+// Overrides the automatic kernel selection, e.g., for benchmarking. isa is one
+// of "avx512", "avx2", or "scalar". Returns false if the CPU does not support the
+// requested instruction set, in which case the selection is not changed.
+bool partition_simd_use(const char* isa) {
+    require_not_null(isa);
+    int error = pthread_once(&simd_once, init_simd);
+    panic_if(error != 0, "error %d", error);
+    if (strcmp(isa, "scalar") == 0) {
+        partition_range_selected = partition_range;
+        simd_isa = "scalar";
+        return true;
+    }
+#ifdef PARTITION_X86
+    if (strcmp(isa, "avx512") == 0 && __builtin_cpu_supports("avx512f")) {
+        partition_range_selected = partition_range_avx512;
+        simd_isa = "avx512";
+        return true;
+    }
+    if (strcmp(isa, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        init_perm_avx2();
+        partition_range_selected = partition_range_avx2;
+        simd_isa = "avx2";
+        return true;
+    }
+#endif
+    return false;
+}
+
+// Block size of the branchless partition (number of elements).
+#define BLOCK_SIZE 64
+
+// Partitions the slice of array a denoted by index range [begin, end) (end
+// exclusive) like partition_range, but without data-dependent branches in the
+// inner loops. Returns the index of the first element > p.
+int partition_range_branchless(int* a, int begin, int end, int p) {
+    require_not_null(a);
+    require("valid bounds", 0 <= begin && begin <= end);
+    unsigned char offsets_l[BLOCK_SIZE], offsets_r[BLOCK_SIZE];
+    int l = begin, r = end - 1; // [begin, l) <= p, (r, end) > p
+    int n_l = 0, n_r = 0; // number of buffered offsets not yet swapped
+    int start_l = 0, start_r = 0; // first buffered offset not yet swapped
+    while (r - l + 1 > 2 * BLOCK_SIZE) {
+        if (n_l == 0) {
+            start_l = 0;
+            for (int i = 0; i < BLOCK_SIZE; i++) {
+                offsets_l[n_l] = i;
+                n_l += a[l + i] > p;
+            }
+        }
+        if (n_r == 0) {
+            start_r = 0;
+            for (int i = 0; i < BLOCK_SIZE; i++) {
+                offsets_r[n_r] = i;
+                n_r += a[r - i] <= p;
+            }
+        }
+        int n = n_l < n_r ? n_l : n_r;
+        for (int k = 0; k < n; k++) {
+            int i = l + offsets_l[start_l + k];
+            int j = r - offsets_r[start_r + k];
+            int h = a[i];
+            a[i] = a[j];
+            a[j] = h;
+        }
+        n_l -= n;
+        n_r -= n;
+        start_l += n;
+        start_r += n;
+        if (n_l == 0) l += BLOCK_SIZE;
+        if (n_r == 0) r -= BLOCK_SIZE;
+    }
+    // a partially processed block may remain on one side, [l, r] is unordered
+    int m = partition_range(a, l, r + 1, p);
+    ensure("lower part <= p", forall_x(int k = begin, k < m, k++, a[k] <= p));
+    ensure("upper part > p", forall_x(int k = m, k < end, k++, a[k] > p));
+    return m;
+}
+
+// Partitions the slice of array a denoted by index interval [low, high] (bounds
+// inclusive) like partition, but uses the branchless block kernel. Returns the
+// index of the pivot element.
+int partition_branchless(int* a, int low, int high) {
+    return partition_with(partition_range_branchless, a, low, high);
+}
+
+static const PartitionScheme schemes[] = {
+    {"hoare", partition, partition_range},
+    {"branchless", partition_branchless, partition_range_branchless},
+    {"simd", partition_simd, partition_range_simd},
+};
+
+// Returns the partitioning scheme with the given name ("hoare", "branchless", or
+// "simd") or NULL if there is no such scheme.
+const PartitionScheme* partition_scheme(const char* name) {
+    require_not_null(name);
+    for (int i = 0; i < sizeof(schemes) / sizeof(schemes[0]); i++) {
+        if (strcmp(schemes[i].name, name) == 0) return &schemes[i];
+    }
+    return NULL;
+}
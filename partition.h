@@ -0,0 +1,31 @@
+/*
+@author: Michael Rohs
+@date: October 17, 2026
+*/
+
+#ifndef partition_h_INCLUDED
+#define partition_h_INCLUDED
+
+#include "util.h"
+
+int partition(int* a, int low, int high);
+int partition_range(int* a, int begin, int end, int p);
+
+int partition_simd(int* a, int low, int high);
+int partition_range_simd(int* a, int begin, int end, int p);
+const char* partition_simd_isa(void);
+bool partition_simd_use(const char* isa);
+
+int partition_branchless(int* a, int low, int high);
+int partition_range_branchless(int* a, int begin, int end, int p);
+
+typedef struct PartitionScheme PartitionScheme;
+struct PartitionScheme {
+    const char* name;
+    int (*partition)(int* a, int low, int high);
+    int (*partition_range)(int* a, int begin, int end, int p);
+};
+
+const PartitionScheme* partition_scheme(const char* name);
+
+#endif // partition_h_INCLUDED
@@ -0,0 +1,88 @@
+#include "partition.h"
+
+// Checks that a[low..high] is partitioned around a[j] and is a permutation of
+// the original values (by comparing sums and sums of squares).
+bool is_partitioned(int* a, int low, int high, int j, long int sum, long int sum2) {
+    if (j < low || j > high) return false;
+    int p = a[j];
+    long int s = 0, s2 = 0;
+    for (int k = low; k <= high; k++) {
+        if (k < j && a[k] > p) return false;
+        if (k > j && a[k] <= p) return false;
+        s += a[k];
+        s2 += (long int)a[k] * a[k];
+    }
+    return s == sum && s2 == sum2;
+}
+
+void fill(int* a, int n, int range) {
+    for (int i = 0; i < n; i++) a[i] = i_rnd(range);
+}
+
+// Partitions arrays of many lengths and value ranges (including few distinct
+// values and slices that do not start at index 0).
+void test_partition(char* name, int (*part)(int* a, int low, int high)) {
+    int n_max = 300;
+    int a[n_max + 10];
+    bool ok = true;
+    for (int n = 1; n <= n_max && ok; n++) {
+        for (int range = 1; range <= 1000 && ok; range *= 10) {
+            for (int r = 0; r < 5 && ok; r++) {
+                int low = i_rnd(10);
+                fill(a, low + n, range);
+                long int sum = 0, sum2 = 0;
+                for (int k = low; k < low + n; k++) {
+                    sum += a[k];
+                    sum2 += (long int)a[k] * a[k];
+                }
+                int j = part(a, low, low + n - 1);
+                ok = is_partitioned(a, low, low + n - 1, j, sum, sum2);
+                if (!ok) printf("%s failed: n = %d, range = %d\n", name, n, range);
+            }
+        }
+    }
+    test_equal_i(ok, true);
+}
+
+// Measures the partitioning throughput in million elements per second.
+double bench_partition(int (*part)(int* a, int low, int high), int* a, int n) {
+    int n_runs = 10;
+    double ms = 0;
+    for (int r = 0; r < n_runs; r++) {
+        fill(a, n, 1 << 30);
+        timespec start = time_now();
+        part(a, 0, n - 1);
+        ms += time_ms_since(start);
+    }
+    return 1e-3 * n * n_runs / ms;
+}
+
+// Run with argument "bench" to measure the throughput of the kernels. This
+// requires a build without contract checks:
+// make clean && make partition_test DEBUG="-O2 -DNO_ASSERT -DNO_REQUIRE -DNO_ENSURE"
+int main(int argc, char* argv[]) {
+    char* isas[] = {"scalar", "avx2", "avx512"};
+    if (argc < 2 || strcmp(argv[1], "bench") != 0) {
+        test_partition("partition", partition);
+        test_partition("branchless", partition_branchless);
+        for (int i = 0; i < 3; i++) {
+            if (partition_simd_use(isas[i])) {
+                test_partition(isas[i], partition_simd);
+            }
+        }
+        return 0;
+    }
+
+    int n = 10000000;
+    int* a = xmalloc(n * sizeof(int));
+    printf("%-10s %12s\n", "kernel", "M elems/s");
+    printf("%-10s %12.1f\n", "partition", bench_partition(partition, a, n));
+    printf("%-10s %12.1f\n", "branchless", bench_partition(partition_branchless, a, n));
+    for (int i = 0; i < 3; i++) {
+        if (partition_simd_use(isas[i])) {
+            printf("%-10s %12.1f\n", isas[i], bench_partition(partition_simd, a, n));
+        }
+    }
+    free(a);
+    return 0;
+}
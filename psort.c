@@ -0,0 +1,991 @@
+/*
+Parallel sorting library. psort sorts arrays of any element type with a
+comparison function, like qsort. The type-specialized variants psort_int,
+psort_float, psort_uint64, and psort_kv are generated by generate_psort (see
+psort.h), which inlines the comparison into the sort loops. The variants for
+integer keys (psort_int, psort_uint64, psort_kv) are wrapped by
+generate_psort_radix, which switches to a radix sort for large arrays. Further
+variants can be generated for other element types in the same way.
+
+The sort is a multithreaded non-recursive version of Quicksort that uses
+unbounded FIFO channels for communication. One step of the algorithm involves
+taking an interval out of the work channel, partitioning the corresponding slice
+of the array to be sorted, and putting the resulting subintervals into the
+channel. Partitioning the interval means picking an element of the slice as a
+pivot element p (median of three, or Tukey's ninther for large slices) and
+rearranging the values such that the items left of the pivot element are less
+than or equal to p and the items to the right of the pivot element are greater
+than p. A countdown of the elements that reached their final position determines
+when the sort is done.
+
+PSORT_MERGESORT selects a stable merge sort instead. The array is split into one
+run per thread, which the workers sort sequentially. The sorted runs are then
+merged pairwise in rounds, alternating between the array and a single scratch
+buffer of n elements. Each merge is divided into tasks of equal output size,
+whose input boundaries are found by binary search along the merge path (Odeh et
+al., Merge Path - Parallel Merging Made Simple, 2012), so all threads take part
+in every round, including the last one. The tasks are distributed over the work
+channel, and a countdown signals the end of each round.
+
+PSORT_SAMPLESORT selects a sample sort, which touches the data only a few times
+and balances the load better on many cores (Sanders and Winkel, Super Scalar
+Sample Sort, 2004). The splitters are picked from a sorted random oversample and
+stored as an implicit binary search tree. Each thread classifies the elements of
+its block by descending the tree without branches, four elements at a time, and
+counts the bucket sizes. After a prefix sum over the counts, the threads scatter
+their elements to the buckets in a scratch buffer, which is then copied back.
+The buckets are sorted by the quicksort workers, whose work channel starts with
+all buckets instead of one interval, so the buckets are partitioned in parallel
+with each other. The classification, the scatter, the copy, and the quicksort
+run on the same pool.
+
+PSORT_RADIXSORT selects an LSD radix sort with 8-bit digits for integer keys.
+Each pass counts the digits per thread block, turns the counts into per-thread
+write positions by a prefix sum, and scatters the elements to a scratch buffer.
+Passes in which all keys have the same digit are skipped. The scatter first
+collects the elements of each bucket in a small per-thread buffer and writes
+them out in blocks of PSORT_RADIX_WC_BYTES (software write-combining), so the
+256 output streams cause fewer cache and TLB misses. Arrays with fewer than
+PSORT_RADIX_BLOCK_SIZE elements per thread use fewer threads. All passes run on
+one pool.
+
+Sending and receiving an interval costs far more than partitioning a few
+elements. Intervals with fewer than grain_size elements are therefore not sent
+to the work channel, but sorted sequentially by the worker that produced them.
+A grain size of 2 or less yields the original behavior, in which every interval
+with at least two elements becomes a channel message.
+
+The workers are the threads of a PSortPool, which the quicksort creates once
+per sort. The intervals are tasks in the pool's channel, which is thus the work
+channel of the quicksort. The merge sort and the batch variants do not use a
+pool, but start their own workers once per call.
+
+At the start there is only one interval, so a single worker would partition the
+whole array while the others wait. An interval with at least
+PSORT_PARALLEL_PARTITION_SIZE elements that is the only one in flight (its size
+equals the countdown) is therefore partitioned by all pool threads together:
+The interval is split into one block per thread, each block is partitioned
+independently around the same pivot, and the elements that ended up on the wrong
+side of the overall split point are swapped in parallel afterwards. The worker
+that owns the interval sends the other blocks to the pool and waits for them on
+a countdown. As no other interval is in flight, the other pool threads are idle
+and take the blocks, so no more than n_threads threads are busy. Once there are
+several intervals, they are partitioned sequentially, in parallel with each
+other.
+
+If the lower part likely contains keys equal to the pivot, they are gathered
+next to the pivot and excluded from further partitioning (fat pivot). As in
+introsort, each interval carries a budget of log2(n) unbalanced splits (where
+the smaller part has less than 1/8 of the elements). An interval whose budget is
+used up is sorted by heapsort. This bounds the total work at O(n log n).
+
+Input that is already sorted or consists of a few sorted runs is detected by a
+scan before sorting, which stops as soon as it has seen more than PSORT_MAX_RUNS
+runs, so it costs little on other input. Strictly descending runs are reversed
+in place (which keeps equal keys in order), and the runs are then merged with
+the merge rounds of the merge sort, in O(n log r) for r runs. Sorted and
+reversed arrays thus take a single pass. If there are too many runs, the
+unstable algorithms try a drop-merge sort instead: A single scan keeps a sorted
+subsequence at the front of the array and drops the other elements to a buffer.
+An element that is smaller than the last kept element either replaces up to
+PSORT_DROP_BACKTRACK kept elements that are larger than it (which handles a few
+adjacent outliers that are too large), or is dropped itself. The dropped
+elements are then sorted and merged with the kept ones. The scan gives up as
+soon as it has dropped more than one in PSORT_MAX_DROP_SHARE elements (plus
+PSORT_DROP_SLACK), which on random input happens after a few dozen elements.
+Nearly sorted input with a few misplaced elements thus takes O(n + d log d) for
+d dropped elements. Similar to pdqsort (Peters, Pattern-defeating Quicksort,
+2021), the quicksort also tries an insertion sort on intervals whose first,
+quartile, middle, and last elements are in order, but gives up after
+PSORT_PARTIAL_INSERTION_LIMIT moves, so intervals that became sorted by the
+partitioning above them are finished in linear time. Random intervals rarely
+pass the check of five elements. All of this can be turned off with the adaptive
+option.
+
+The select and partial_sort variants find the element of rank k, or the k
+smallest elements, without sorting the whole array (Hoare's Find, i.e.,
+quickselect). They partition like the quicksort, but continue only with the
+part that contains position k, so they take O(n) expected time. As there is only
+one interval at a time, each interval with at least
+PSORT_PARALLEL_PARTITION_SIZE elements is partitioned by all threads of a pool
+that is created once per call. The partial sort then sorts the first k elements.
+psort_top_k keeps the k smallest items of a stream that arrives over a channel
+in a bounded max-heap, without storing the stream.
+
+The batch variants sort many independent arrays. Setting up threads and channels
+for each of them would cost more than sorting a small array, so the small arrays
+are instead distributed over the workers in chunks of consecutive arrays, and
+each is sorted by a single thread. Only arrays with at least
+PSORT_BATCH_LARGE_SIZE elements are sorted with all threads.
+
+The argsort variants return the stable sorting permutation instead of moving the
+elements, which pays off if the elements are large records or are stored as a
+struct of arrays. psort_argsort_int and psort_argsort_float pack each key with
+its index into a 64-bit word (key bits mapped such that the unsigned order is the
+key order), so the sort moves 8 bytes per element, and the radix sort applies.
+psort_gather and psort_permute_columns then apply the permutation to the
+payload columns in parallel.
+
+psort_fill_random_int and psort_check_int prepare and verify benchmark inputs
+in parallel, so that setting up a large array does not take longer than sorting
+it. The fill is a plain parallel fill: its threads are not pinned and are not
+the threads that later sort the array, so it does not control on which NUMA node
+the pages are placed. Each segment of PSORT_FILL_BLOCK_SIZE elements has its own
+random stream, seeded from the seed and the segment index, so the array does not
+depend on the number of threads. The check tests sortedness and computes a
+checksum that does not depend on the order of the elements, so comparing the
+checksums before and after sorting shows that the result is a permutation of the
+input.
+
+psort_int partitions with the kernels of partition.c. The scheme can be selected
+in the options: hoare, branchless, or simd (the default). Slices of up to
+SORTNET_MAX ints are sorted by the vectorized sorting networks of sortnet.c.
+
+All sizes and indices are 64 bits wide (long int, size_t), including the
+intervals in the work channel, the countdown, and the channel's queue, so arrays
+may have more than 2^31 elements. The int partition kernels keep their 32-bit
+indices and are applied relative to the start of each slice, which is shorter
+than 2^31 elements except for the first few partitions of huge arrays.
+
+psort sorts an array of references to the elements with the given comparison
+function and then moves the elements into place, so each element is moved only
+once regardless of its size.
+
+@author: Michael Rohs
+@date: October 17, 2026
+*/
+
+#include <pthread.h>
+#include <unistd.h>
+#include "psort.h"
+
+// Returns the default options: one thread per online processor, default grain
+// size, and fat pivots.
+PSortOptions psort_options(void) {
+    long int n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_cpus < 1) n_cpus = 1;
+    if (n_cpus > PSORT_THREADS_MAX) n_cpus = PSORT_THREADS_MAX;
+    return (PSortOptions){
+        .n_threads = (int)n_cpus,
+        .grain_size = PSORT_GRAIN_SIZE,
+        .algorithm = PSORT_AUTO,
+        .scheme = NULL,
+        .fat_pivot = true,
+        .adaptive = true,
+    };
+}
+
+// Returns a copy of opts, or the default options if opts is NULL, with the
+// number of threads limited to PSORT_THREADS_MAX.
+PSortOptions psort_resolve_options(const PSortOptions* opts) {
+    PSortOptions o = opts != NULL ? *opts : psort_options();
+    require("positive", o.n_threads > 0);
+    if (o.n_threads > PSORT_THREADS_MAX) o.n_threads = PSORT_THREADS_MAX;
+    return o;
+}
+
+// Returns the number of unbalanced splits that an interval of n elements may
+// have before it is sorted by heapsort.
+int psort_split_budget(long int n) {
+    int budget = 0;
+    while (n > 1) {
+        n >>= 1;
+        budget++;
+    }
+    return budget;
+}
+
+// Checks whether the split of an interval of n elements into parts of n_left
+// and n_right elements is unbalanced.
+bool psort_is_unbalanced(long int n, long int n_left, long int n_right) {
+    long int n_smaller = n_left < n_right ? n_left : n_right;
+    return n_smaller < n / 8;
+}
+
+// Splits the range [begin, end) into n_blocks blocks of about equal size.
+void psort_split_blocks(PSortBlocks* b, long int begin, long int end, int n_blocks) {
+    require_not_null(b);
+    require("valid block count", 0 < n_blocks && n_blocks <= PSORT_THREADS_MAX);
+    long int n = end - begin;
+    b->n_blocks = n_blocks;
+    for (int t = 0; t < n_blocks; t++) {
+        b->blocks[t].begin = begin + n * t / n_blocks;
+        b->blocks[t].end = begin + n * (t + 1) / n_blocks;
+    }
+}
+
+// Determines the split point m of the partitioned blocks, which is where the
+// elements <= p would end after merging, and collects the ranges of elements that
+// are on the wrong side of m. Returns m.
+long int psort_collect_misplaced(PSortBlocks* b) {
+    require_not_null(b);
+    long int m = b->blocks[0].begin;
+    for (int t = 0; t < b->n_blocks; t++) {
+        m += b->splits[t] - b->blocks[t].begin;
+    }
+    long int n_left = 0, n_right = 0;
+    for (int t = 0; t < b->n_blocks; t++) {
+        PSortRange r = b->blocks[t];
+        long int s = b->splits[t];
+        PSortRange ml = {s, r.end < m ? r.end : m};
+        if (ml.begin > ml.end) ml.end = ml.begin;
+        PSortRange mr = {r.begin > m ? r.begin : m, s};
+        if (mr.begin > mr.end) mr.begin = mr.end;
+        b->misplaced_left[t] = ml;
+        b->misplaced_right[t] = mr;
+        n_left += ml.end - ml.begin;
+        n_right += mr.end - mr.begin;
+    }
+    assert("misplaced counts match", n_left == n_right);
+    b->n_misplaced = n_left;
+    return m;
+}
+
+// Returns the share [*from, *to) of the misplaced elements that thread t swaps.
+void psort_misplaced_share(PSortBlocks* b, int t, long int* from, long int* to) {
+    *from = b->n_misplaced * t / b->n_blocks;
+    *to = b->n_misplaced * (t + 1) / b->n_blocks;
+}
+
+// Skips to the next non-empty range, starting at range *r with offset *offset.
+void psort_skip_empty_ranges(PSortRange* ranges, int* r, long int* offset) {
+    while (*offset >= ranges[*r].end - ranges[*r].begin) {
+        *offset -= ranges[*r].end - ranges[*r].begin;
+        (*r)++;
+    }
+}
+
+struct PSortPool {
+    int n_threads;
+    UChan* ch_tasks; // PSortTask by value
+    Countdown* blocks_left; // of the running psort_run_on_pool
+    void* shared; // of the running psort_run_on_pool
+    void* (*f)(void*); // of the running psort_run_on_pool
+    pthread_t threads[];
+};
+
+static void* pool_thread(void* arg) {
+    PSortPool* pool = arg;
+    PSortTask t;
+    while (uchan_receive2_elem(pool->ch_tasks, &t)) t.run(&t);
+    return NULL;
+}
+
+// Starts a pool of n_threads threads that wait for tasks.
+PSortPool* psort_pool_new(int n_threads) {
+    require("valid thread count", 0 < n_threads && n_threads <= PSORT_THREADS_MAX);
+    PSortPool* pool = xcalloc(1, sizeof(PSortPool) + n_threads * sizeof(pthread_t));
+    pool->n_threads = n_threads;
+    pool->ch_tasks = uchan_new_sized(sizeof(PSortTask));
+    pool->blocks_left = countdown_new(0);
+    psort_start_workers(pool->threads, n_threads, pool_thread, pool);
+    return pool;
+}
+
+// Lets the threads of the pool finish the tasks that have been sent, waits for
+// them to end, and frees the pool. Does nothing if pool is NULL. Countdowns that
+// the tasks signal must be freed afterwards, as a thread may still be signaling
+// one that has reached zero.
+void psort_pool_free(PSortPool* pool) {
+    if (pool == NULL) return;
+    psort_stop_workers(pool->threads, pool->n_threads, pool->ch_tasks);
+    countdown_free(pool->blocks_left);
+    uchan_free(pool->ch_tasks);
+    free(pool);
+}
+
+// Returns the number of threads of the pool.
+int psort_pool_size(PSortPool* pool) {
+    require_not_null(pool);
+    return pool->n_threads;
+}
+
+// Sends a task to the pool, which runs it on one of its threads.
+void psort_pool_send(PSortPool* pool, PSortTask t) {
+    require_not_null(pool);
+    require_not_null(t.run);
+    uchan_send_elem(pool->ch_tasks, &t);
+}
+
+static void run_block(const PSortTask* t) {
+    PSortPool* pool = t->shared;
+    PSortBlockArg ba = {pool->shared, (int)t->low};
+    pool->f(&ba);
+    countdown_dec(pool->blocks_left);
+}
+
+// Runs f for each block and returns when all blocks are done. The calling thread
+// runs the first block, the pool threads the others. If pool is NULL, the calling
+// thread runs all blocks. Only one psort_run_on_pool may run on a pool at a time,
+// and if it is called from a pool thread, the other pool threads must be free to
+// take the blocks.
+void psort_run_on_pool(PSortPool* pool, void* shared, int n_blocks, void* (*f)(void*)) {
+    require_not_null(shared);
+    require("valid block count", 0 < n_blocks && (pool == NULL || n_blocks <= pool->n_threads + 1));
+    if (pool == NULL || n_blocks == 1) {
+        for (int t = 0; t < n_blocks; t++) f(&(PSortBlockArg){shared, t});
+        return;
+    }
+    pool->shared = shared;
+    pool->f = f;
+    countdown_set(pool->blocks_left, n_blocks - 1);
+    PSortTask tasks[n_blocks - 1];
+    for (int t = 1; t < n_blocks; t++) {
+        tasks[t - 1] = (PSortTask){.run = run_block, .shared = pool, .low = t};
+    }
+    uchan_send_n(pool->ch_tasks, tasks, n_blocks - 1);
+    f(&(PSortBlockArg){shared, 0});
+    countdown_wait(pool->blocks_left);
+}
+
+// Runs f for each block like psort_run_on_pool, on a pool that exists only for
+// this call. This is for single parallel steps. Steps that are repeated within
+// an operation should share a pool.
+void psort_run_on_blocks(void* shared, int n_blocks, void* (*f)(void*)) {
+    PSortPool* pool = n_blocks > 1 ? psort_pool_new(n_blocks - 1) : NULL;
+    psort_run_on_pool(pool, shared, n_blocks, f);
+    psort_pool_free(pool);
+}
+
+// Starts n_threads worker threads with function f and argument arg.
+void psort_start_workers(pthread_t* threads, int n_threads, void* (*f)(void*), void* arg) {
+    require_not_null(threads);
+    require("valid thread count", 0 < n_threads && n_threads <= PSORT_THREADS_MAX);
+    for (int i = 0; i < n_threads; i++) {
+        int error = pthread_create(&threads[i], NULL, f, arg);
+        panic_if(error != 0, "error %d", error);
+    }
+}
+
+// Closes the work channel and waits for the worker threads to finish.
+void psort_stop_workers(pthread_t* threads, int n_threads, UChan* ch_work) {
+    require_not_null(threads);
+    uchan_close(ch_work);
+    for (int i = 0; i < n_threads; i++) {
+        int error = pthread_join(threads[i], NULL);
+        panic_if(error != 0, "error %d", error);
+    }
+}
+
+// Sends a merge task to the channel, which stores it by value.
+void psort_send_merge_task(UChan* ch, PSortMergeTask t) {
+    uchan_send_elem(ch, &t);
+}
+
+// Receives a merge task from the channel. Returns false if the channel has been
+// closed and no more tasks are available.
+bool psort_receive_merge_task(UChan* ch, PSortMergeTask* t) {
+    return uchan_receive2_elem(ch, t);
+}
+
+// Sends the tasks of one merge round to the channel. The sorted runs are given by
+// their boundaries bounds[0..n_runs]. They are merged pairwise, a trailing run
+// without partner is copied. Each merge is split into tasks of chunk output
+// elements. The task boundaries are mapped to the input runs by the workers
+// (merge path), so all tasks have the same size regardless of the distribution of
+// the keys. The boundaries of the merged runs are written back to bounds. Returns
+// their number.
+int psort_send_merge_tasks(UChan* ch, long int* bounds, int n_runs, long int chunk, bool from_scratch) {
+    require_not_null(bounds);
+    require("positive", n_runs > 0 && chunk > 0);
+    int m = 0;
+    for (int r = 0; r < n_runs; r += 2) {
+        long int lo = bounds[r], mid = bounds[r + 1];
+        long int hi = r + 1 < n_runs ? bounds[r + 2] : mid;
+        for (long int d0 = 0; d0 < hi - lo; d0 += chunk) {
+            long int d1 = d0 + chunk < hi - lo ? d0 + chunk : hi - lo;
+            psort_send_merge_task(ch, (PSortMergeTask){lo, mid, hi, d0, d1, false, from_scratch});
+        }
+        bounds[m++] = lo;
+    }
+    bounds[m] = bounds[n_runs];
+    return m;
+}
+
+// Returns the next number of a xorshift64* generator with the given state.
+uint64_t psort_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+// Turns the per-thread bucket sizes counts[t * k + b] into the positions at which
+// thread t writes the elements of bucket b. The buckets are laid out one after
+// the other, and within each bucket the threads in order. Writes the range of
+// each bucket to buckets.
+void psort_bucket_offsets(long int* counts, int n_threads, int k, PSortRange* buckets) {
+    require_not_null(counts);
+    require_not_null(buckets);
+    long int offset = 0;
+    for (int b = 0; b < k; b++) {
+        buckets[b].begin = offset;
+        for (int t = 0; t < n_threads; t++) {
+            long int count = counts[t * k + b];
+            counts[t * k + b] = offset;
+            offset += count;
+        }
+        buckets[b].end = offset;
+    }
+}
+
+// Checks whether all n elements are in a single bucket.
+bool psort_is_single_bucket(const PSortRange* buckets, int k, long int n) {
+    for (int b = 0; b < k; b++) {
+        if (buckets[b].end - buckets[b].begin == n) return true;
+    }
+    return false;
+}
+
+typedef struct {
+    PSortBlocks b;
+    char* dst;
+    const char* src;
+} ParallelCopy;
+
+static void* copy_block(void* arg) {
+    PSortBlockArg* ba = arg;
+    ParallelCopy* pc = ba->shared;
+    PSortRange r = pc->b.blocks[ba->t];
+    memcpy(pc->dst + r.begin, pc->src + r.begin, r.end - r.begin);
+    return NULL;
+}
+
+// Copies n_bytes from src to dst in n_blocks blocks on the pool (see
+// psort_run_on_pool). The areas must not overlap.
+void psort_pool_copy(PSortPool* pool, void* dst, const void* src, size_t n_bytes, int n_blocks) {
+    require_not_null(dst);
+    require_not_null(src);
+    ParallelCopy* pc = xmalloc(sizeof(ParallelCopy));
+    pc->dst = dst;
+    pc->src = src;
+    psort_split_blocks(&pc->b, 0, (long int)n_bytes, n_blocks);
+    psort_run_on_pool(pool, pc, n_blocks, copy_block);
+    free(pc);
+}
+
+// Copies n_bytes from src to dst with n_threads threads. The areas must not
+// overlap.
+void psort_parallel_copy(void* dst, const void* src, size_t n_bytes, int n_threads) {
+    PSortPool* pool = n_threads > 1 ? psort_pool_new(n_threads - 1) : NULL;
+    psort_pool_copy(pool, dst, src, n_bytes, n_threads);
+    psort_pool_free(pool);
+}
+
+// Partitions a[begin..end-1] like partition_range, but with 64-bit indices.
+static long int psort_int_partition_long(int* a, long int begin, long int end, int p) {
+    long int i = begin, j = end - 1;
+    while (true) {
+        while (i <= j && a[i] <= p) i++;
+        while (i <= j && a[j] > p) j--;
+        if (i > j) break;
+        int h = a[i]; a[i] = a[j]; a[j] = h;
+        i++; j--;
+    }
+    return i;
+}
+
+// Partitions with the range kernel of the configured scheme. The kernels of
+// partition.c take int indices, so they are applied relative to the start of the
+// slice, which leaves only slices of more than INT_MAX elements to the scalar
+// partition with 64-bit indices.
+static inline long int psort_int_partition_le(const PSortOptions* opts, int* a, long int begin, long int end, int p) {
+    if (end - begin > INT_MAX) return psort_int_partition_long(a, begin, end, p);
+    int n = (int)(end - begin);
+    if (opts->scheme == NULL) return begin + partition_range_simd(a + begin, 0, n, p);
+    return begin + opts->scheme->partition_range(a + begin, 0, n, p);
+}
+
+static inline long int psort_int_partition_lt(const PSortOptions* opts, int* a, long int begin, long int end, int p) {
+    // no int is less than INT_MIN
+    if (p == INT_MIN) return begin;
+    return psort_int_partition_le(opts, a, begin, end, p - 1);
+}
+
+// Sorts short slices with a sorting network. Equal ints cannot be told apart,
+// so the merge sort stays stable.
+static inline void psort_int_small_sort(int* a, long int n) {
+    sortnet_int(a, (int)n);
+}
+
+generate_psort_with(psort_int_compare, int, psort_less, psort_int_partition_le, psort_int_partition_lt,
+                    psort_int_small_sort, SORTNET_MAX)
+generate_psort_radix(psort_int, int, uint32_t, psort_key_int, psort_int_compare)
+generate_psort(psort_float, float, psort_less_float)
+generate_psort(psort_uint64_compare, uint64_t, psort_less)
+generate_psort_radix(psort_uint64, uint64_t, uint64_t, psort_key_uint64, psort_uint64_compare)
+generate_psort(psort_kv_compare, PSortKV, psort_less_key)
+generate_psort_radix(psort_kv, PSortKV, uint64_t, psort_key_kv, psort_kv_compare)
+
+typedef struct {
+    void** arrays;
+    const size_t* lengths;
+    PSortBatchFunc sort;
+    PSortOptions opts;
+    UChan* ch_work;
+} PSortBatch;
+
+// Sorts the chunks of arrays that are sent to the work channel, each array with a
+// single thread.
+static void* batch_worker(void* arg) {
+    PSortBatch* b = arg;
+    PSortRange r;
+    while (uchan_receive2_elem(b->ch_work, &r)) {
+        for (long int i = r.begin; i < r.end; i++) {
+            if (b->lengths[i] < PSORT_BATCH_LARGE_SIZE) b->sort(b->arrays[i], b->lengths[i], &b->opts);
+        }
+    }
+    return NULL;
+}
+
+// Sorts each of the n_arrays arrays with sort. Arrays with at least
+// PSORT_BATCH_LARGE_SIZE elements are sorted one after the other with all
+// threads. The others are sorted sequentially and in parallel with each other:
+// Consecutive arrays are grouped into chunks of about the same total length,
+// which the workers take from the work channel, so the channel is not used for
+// every small array and the threads stay busy until the end.
+void psort_run_batch(void** arrays, const size_t* lengths, size_t n_arrays, PSortBatchFunc sort, const PSortOptions* opts) {
+    require("valid arrays", (arrays != NULL && lengths != NULL) || n_arrays == 0);
+    require_not_null(sort);
+    PSortOptions o = psort_resolve_options(opts);
+    size_t total = 0;
+    for (size_t i = 0; i < n_arrays; i++) {
+        if (lengths[i] >= PSORT_BATCH_LARGE_SIZE) sort(arrays[i], lengths[i], &o);
+        else total += lengths[i];
+    }
+    PSortBatch b = {arrays, lengths, sort, o, uchan_new_sized(sizeof(PSortRange))};
+    b.opts.n_threads = 1;
+    size_t chunk = total / (16 * (size_t)o.n_threads);
+    if (chunk < PSORT_BATCH_CHUNK_SIZE) chunk = PSORT_BATCH_CHUNK_SIZE;
+    size_t begin = 0, size = 0;
+    for (size_t i = 0; i < n_arrays; i++) {
+        if (lengths[i] < PSORT_BATCH_LARGE_SIZE) size += lengths[i] + 1;
+        if (size >= chunk || i == n_arrays - 1) {
+            PSortRange r = {(long int)begin, (long int)i + 1};
+            uchan_send_elem(b.ch_work, &r);
+            begin = i + 1;
+            size = 0;
+        }
+    }
+    if (o.n_threads == 1) {
+        uchan_close(b.ch_work);
+        batch_worker(&b);
+    } else {
+        pthread_t threads[o.n_threads];
+        psort_start_workers(threads, o.n_threads, batch_worker, &b);
+        psort_stop_workers(threads, o.n_threads, b.ch_work);
+    }
+    uchan_free(b.ch_work);
+}
+
+generate_psort_batch(psort_int, int)
+generate_psort_batch(psort_float, float)
+generate_psort_batch(psort_uint64, uint64_t)
+generate_psort_batch(psort_kv, PSortKV)
+
+// Refers to an element of the array that psort sorts.
+typedef struct {
+    char* p;
+    PSortCompare cmp;
+} PSortRef;
+
+#define psort_less_ref(x, y) ((x).cmp((x).p, (y).p) < 0)
+
+generate_psort(psort_refs, PSortRef, psort_less_ref)
+
+// Moves the elements of base into the order given by refs, in which refs[i] is
+// the element that belongs at position i.
+static void psort_apply_refs(char* b, PSortRef* refs, size_t n, size_t elem_size) {
+    // follow the cycles of the permutation and mark each position as done by
+    // pointing it to itself
+    char* x = xmalloc(elem_size);
+    for (size_t i = 0; i < n; i++) {
+        char* pi = b + i * elem_size;
+        if (refs[i].p == pi) continue;
+        memcpy(x, pi, elem_size);
+        size_t j = i;
+        while (true) {
+            char* pj = b + j * elem_size;
+            size_t k = (size_t)(refs[j].p - b) / elem_size;
+            refs[j].p = pj;
+            if (k == i) {
+                memcpy(pj, x, elem_size);
+                break;
+            }
+            memcpy(pj, b + k * elem_size, elem_size);
+            j = k;
+        }
+    }
+    free(x);
+}
+
+// Returns references to the n elements of base for psort_refs.
+static PSortRef* psort_new_refs(char* b, size_t n, size_t elem_size, PSortCompare cmp) {
+    PSortRef* refs = xmalloc(n * sizeof(PSortRef));
+    for (size_t i = 0; i < n; i++) {
+        refs[i] = (PSortRef){b + i * elem_size, cmp};
+    }
+    return refs;
+}
+
+// Sorts the n elements of size elem_size at base in ascending order as defined by
+// cmp, which returns a negative value, zero, or a positive value if the first
+// element is less than, equal to, or greater than the second element.
+void psort(void* base, size_t n, size_t elem_size, PSortCompare cmp, const PSortOptions* opts) {
+    require("valid array", base != NULL || n == 0);
+    require("positive", elem_size > 0);
+    require_not_null(cmp);
+    if (n < 2) return;
+    PSortRef* refs = psort_new_refs(base, n, elem_size, cmp);
+    psort_refs(refs, n, opts);
+    psort_apply_refs(base, refs, n, elem_size);
+    free(refs);
+}
+
+// Rearranges the n elements of size elem_size at base, such that the element at
+// position k is the one that would be there after sorting, no element before it
+// is greater, and no element after it is smaller.
+void psort_select(void* base, size_t n, size_t elem_size, size_t k, PSortCompare cmp, const PSortOptions* opts) {
+    require("valid array", base != NULL);
+    require("positive", elem_size > 0);
+    require_not_null(cmp);
+    require("valid index", k < n);
+    PSortRef* refs = psort_new_refs(base, n, elem_size, cmp);
+    psort_refs_select(refs, n, k, opts);
+    psort_apply_refs(base, refs, n, elem_size);
+    free(refs);
+}
+
+// Moves the k smallest of the n elements of size elem_size at base to the front
+// in sorted order. The order of the remaining elements is unspecified.
+void psort_partial_sort(void* base, size_t n, size_t elem_size, size_t k, PSortCompare cmp, const PSortOptions* opts) {
+    require("valid array", base != NULL || n == 0);
+    require("positive", elem_size > 0);
+    require_not_null(cmp);
+    require("valid count", k <= n);
+    if (k == 0) return;
+    PSortRef* refs = psort_new_refs(base, n, elem_size, cmp);
+    psort_refs_partial_sort(refs, n, k, opts);
+    psort_apply_refs(base, refs, n, elem_size);
+    free(refs);
+}
+
+static void top_k_sift_down(void** h, size_t i, size_t n, PSortCompare cmp) {
+    void* x = h[i];
+    while (true) {
+        size_t c = 2 * i + 1;
+        if (c >= n) break;
+        if (c + 1 < n && cmp(h[c], h[c + 1]) < 0) c++;
+        if (cmp(x, h[c]) >= 0) break;
+        h[i] = h[c];
+        i = c;
+    }
+    h[i] = x;
+}
+
+// Receives items from ch until it is closed and keeps the k smallest of them in
+// top, without storing the others. cmp is called with the items themselves.
+// Items that do not make it into top, or are pushed out of it, are passed to
+// discard, unless it is NULL. Returns the number of items in top, which is less
+// than k if fewer items were received. They are sorted in ascending order.
+size_t psort_top_k(UChan* ch, void** top, size_t k, PSortCompare cmp, void (*discard)(void* x)) {
+    require_not_null(ch);
+    require("valid buffer", top != NULL || k == 0);
+    require_not_null(cmp);
+    // top is a max-heap of the n smallest items so far
+    size_t n = 0;
+    void* x;
+    while (uchan_receive2(ch, &x)) {
+        if (n < k) {
+            size_t i = n++;
+            while (i > 0 && cmp(top[(i - 1) / 2], x) < 0) {
+                top[i] = top[(i - 1) / 2];
+                i = (i - 1) / 2;
+            }
+            top[i] = x;
+        } else if (k > 0 && cmp(x, top[0]) < 0) {
+            if (discard != NULL) discard(top[0]);
+            top[0] = x;
+            top_k_sift_down(top, 0, n, cmp);
+        } else if (discard != NULL) {
+            discard(x);
+        }
+    }
+    for (size_t end = n; end > 1; end--) {
+        void* h = top[0];
+        top[0] = top[end - 1];
+        top[end - 1] = h;
+        top_k_sift_down(top, 0, end - 1, cmp);
+    }
+    ensure("sorted", forall_x(size_t i = 1, i < n, i++, cmp(top[i - 1], top[i]) <= 0));
+    return n;
+}
+
+// Computes the stable sorting permutation of the n elements of size elem_size at
+// base: perm[i] is the index of the element that belongs at position i. The
+// elements are not moved.
+void psort_argsort(const void* base, size_t n, size_t elem_size, PSortCompare cmp, size_t* perm, const PSortOptions* opts) {
+    require("valid array", (base != NULL && perm != NULL) || n == 0);
+    require("positive", elem_size > 0);
+    require_not_null(cmp);
+    if (n == 0) return;
+    char* b = (char*)base;
+    PSortRef* refs = psort_new_refs(b, n, elem_size, cmp);
+    // the merge sort keeps equal elements in index order
+    PSortOptions o = psort_resolve_options(opts);
+    o.algorithm = PSORT_MERGESORT;
+    psort_refs(refs, n, &o);
+    for (size_t i = 0; i < n; i++) perm[i] = (size_t)(refs[i].p - b) / elem_size;
+    free(refs);
+}
+
+// Sorts n packed (key, index) pairs with the key in the upper 32 bits and
+// extracts the indices.
+static void argsort_packed(uint64_t* pairs, size_t n, size_t* perm, const PSortOptions* opts) {
+    psort_uint64(pairs, n, opts);
+    for (size_t i = 0; i < n; i++) perm[i] = (size_t)(pairs[i] & 0xffffffffu);
+    free(pairs);
+}
+
+// Sorts n (key, index) pairs stably and extracts the indices. This is used for
+// arrays whose indices do not fit into 32 bits.
+static void argsort_pairs(PSortKV* pairs, size_t n, size_t* perm, const PSortOptions* opts) {
+    PSortOptions o = psort_resolve_options(opts);
+    // the quicksort would not keep equal keys in index order
+    if (o.algorithm == PSORT_AUTO) o.algorithm = n >= PSORT_RADIX_MIN_SIZE ? PSORT_RADIXSORT : PSORT_MERGESORT;
+    if (o.algorithm != PSORT_RADIXSORT) o.algorithm = PSORT_MERGESORT;
+    psort_kv(pairs, n, &o);
+    for (size_t i = 0; i < n; i++) perm[i] = (size_t)pairs[i].value;
+    free(pairs);
+}
+
+// Computes the stable sorting permutation of keys, see psort_argsort. Each key is
+// packed with its index into a 64-bit word, so the sort moves 8 bytes per
+// element and the index breaks ties. Beyond 2^32 elements, keys and indices are
+// sorted as PSortKV pairs.
+void psort_argsort_int(const int* keys, size_t n, size_t* perm, const PSortOptions* opts) {
+    require("valid array", (keys != NULL && perm != NULL) || n == 0);
+    if (n > UINT32_MAX) {
+        PSortKV* pairs = xmalloc(n * sizeof(PSortKV));
+        for (size_t i = 0; i < n; i++) pairs[i] = (PSortKV){psort_key_int(keys[i]), i};
+        argsort_pairs(pairs, n, perm, opts);
+        return;
+    }
+    uint64_t* pairs = xmalloc(n * sizeof(uint64_t));
+    for (size_t i = 0; i < n; i++) pairs[i] = (uint64_t)psort_key_int(keys[i]) << 32 | i;
+    argsort_packed(pairs, n, perm, opts);
+}
+
+// Maps a float to an unsigned integer of the same order. NaNs are greater than all
+// other floats, as with psort_less_float.
+static uint32_t float_key(float x) {
+    if (x != x) return UINT32_MAX;
+    if (x == 0) return 0x80000000u; // -0 == 0
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    // flip all bits of negative floats and the sign bit of the others
+    return bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+}
+
+// Computes the stable sorting permutation of keys, see psort_argsort_int. NaNs
+// come last, as with psort_float.
+void psort_argsort_float(const float* keys, size_t n, size_t* perm, const PSortOptions* opts) {
+    require("valid array", (keys != NULL && perm != NULL) || n == 0);
+    if (n > UINT32_MAX) {
+        PSortKV* pairs = xmalloc(n * sizeof(PSortKV));
+        for (size_t i = 0; i < n; i++) pairs[i] = (PSortKV){float_key(keys[i]), i};
+        argsort_pairs(pairs, n, perm, opts);
+        return;
+    }
+    uint64_t* pairs = xmalloc(n * sizeof(uint64_t));
+    for (size_t i = 0; i < n; i++) pairs[i] = (uint64_t)float_key(keys[i]) << 32 | i;
+    argsort_packed(pairs, n, perm, opts);
+}
+
+// Computes the stable sorting permutation of keys, see psort_argsort. The keys
+// are sorted as (key, index) pairs with the stable radix sort of psort_kv.
+void psort_argsort_uint64(const uint64_t* keys, size_t n, size_t* perm, const PSortOptions* opts) {
+    require("valid array", (keys != NULL && perm != NULL) || n == 0);
+    PSortKV* pairs = xmalloc(n * sizeof(PSortKV));
+    for (size_t i = 0; i < n; i++) pairs[i] = (PSortKV){keys[i], i};
+    argsort_pairs(pairs, n, perm, opts);
+}
+
+typedef struct {
+    PSortBlocks b;
+    char* dst;
+    const char* src;
+    size_t elem_size;
+    const size_t* perm;
+} ParallelGather;
+
+static void* gather_block(void* arg) {
+    PSortBlockArg* ba = arg;
+    ParallelGather* g = ba->shared;
+    PSortRange r = g->b.blocks[ba->t];
+    const size_t* perm = g->perm;
+    // constant sizes let the compiler replace memcpy with a single move
+    switch (g->elem_size) {
+        case 4:
+            for (long int i = r.begin; i < r.end; i++) memcpy(g->dst + 4 * i, g->src + 4 * perm[i], 4);
+            break;
+        case 8:
+            for (long int i = r.begin; i < r.end; i++) memcpy(g->dst + 8 * i, g->src + 8 * perm[i], 8);
+            break;
+        case 16:
+            for (long int i = r.begin; i < r.end; i++) memcpy(g->dst + 16 * i, g->src + 16 * perm[i], 16);
+            break;
+        default: {
+            size_t size = g->elem_size;
+            for (long int i = r.begin; i < r.end; i++) memcpy(g->dst + size * i, g->src + size * perm[i], size);
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Returns the number of threads for processing n elements, such that each
+// thread gets at least block_size elements.
+static int block_threads(size_t n, size_t block_size, int n_threads) {
+    size_t max_threads = n / block_size;
+    return max_threads < 1 ? 1 : max_threads < (size_t)n_threads ? (int)max_threads : n_threads;
+}
+
+// Gathers like psort_gather, in n_blocks blocks on the pool.
+static void gather_on_pool(PSortPool* pool, int n_blocks, void* dst, const void* src, size_t elem_size, const size_t* perm, size_t n) {
+    ParallelGather* g = xmalloc(sizeof(ParallelGather));
+    *g = (ParallelGather){.dst = dst, .src = src, .elem_size = elem_size, .perm = perm};
+    psort_split_blocks(&g->b, 0, (long int)n, n_blocks);
+    psort_run_on_pool(pool, g, n_blocks, gather_block);
+    free(g);
+}
+
+// Sets dst[i] = src[perm[i]] for the n elements of size elem_size, in parallel
+// for large arrays. dst and src must not overlap.
+void psort_gather(void* dst, const void* src, size_t elem_size, const size_t* perm, size_t n, const PSortOptions* opts) {
+    require("valid arrays", (dst != NULL && src != NULL && perm != NULL) || n == 0);
+    require("positive", elem_size > 0);
+    PSortOptions o = psort_resolve_options(opts);
+    int n_threads = block_threads(n, PSORT_GATHER_BLOCK_SIZE, o.n_threads);
+    PSortPool* pool = n_threads > 1 ? psort_pool_new(n_threads - 1) : NULL;
+    gather_on_pool(pool, n_threads, dst, src, elem_size, perm, n);
+    psort_pool_free(pool);
+}
+
+// Applies perm (e.g., from an argsort) to each of the n_columns arrays of n
+// elements of a struct-of-arrays layout, in place: Element i of each column is
+// replaced by element perm[i]. Column c has elements of size elem_sizes[c].
+void psort_permute_columns(void** columns, const size_t* elem_sizes, int n_columns, const size_t* perm, size_t n, const PSortOptions* opts) {
+    require("valid columns", (columns != NULL && elem_sizes != NULL) || n_columns == 0);
+    require("valid permutation", perm != NULL || n == 0);
+    size_t max_size = 0;
+    for (int c = 0; c < n_columns; c++) {
+        if (elem_sizes[c] > max_size) max_size = elem_sizes[c];
+    }
+    PSortOptions o = psort_resolve_options(opts);
+    int n_threads = block_threads(n, PSORT_GATHER_BLOCK_SIZE, o.n_threads);
+    PSortPool* pool = n_threads > 1 ? psort_pool_new(n_threads - 1) : NULL;
+    char* scratch = xmalloc(n * max_size + 1);
+    for (int c = 0; c < n_columns; c++) {
+        gather_on_pool(pool, n_threads, scratch, columns[c], elem_sizes[c], perm, n);
+        psort_pool_copy(pool, columns[c], scratch, n * elem_sizes[c], n_threads);
+    }
+    free(scratch);
+    psort_pool_free(pool);
+}
+
+typedef struct {
+    PSortBlocks b; // blocks of segments
+    int* a;
+    size_t n;
+    uint32_t range;
+    uint64_t seed;
+} ParallelFill;
+
+// Mixes x into a well-distributed 64-bit value (the finalizer of splitmix64).
+static inline uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static void* fill_block(void* arg) {
+    PSortBlockArg* ba = arg;
+    ParallelFill* f = ba->shared;
+    PSortRange r = f->b.blocks[ba->t];
+    for (long int s = r.begin; s < r.end; s++) {
+        uint64_t state = mix64(f->seed + 0x9e3779b97f4a7c15ULL * (uint64_t)(s + 1)) | 1;
+        size_t begin = (size_t)s * PSORT_FILL_BLOCK_SIZE;
+        size_t end = begin + PSORT_FILL_BLOCK_SIZE < f->n ? begin + PSORT_FILL_BLOCK_SIZE : f->n;
+        if (f->range == 0) {
+            for (size_t i = begin; i < end; i++) f->a[i] = (int)(uint32_t)(psort_random(&state) >> 32);
+        } else {
+            for (size_t i = begin; i < end; i++) f->a[i] = (int)(((psort_random(&state) >> 32) * f->range) >> 32);
+        }
+    }
+    return NULL;
+}
+
+// Fills a[0..n-1] with random ints in [0, range), or with arbitrary ints if range
+// is 0, using up to n_threads threads. The result depends only on n, range, and
+// seed.
+void psort_fill_random_int(int* a, size_t n, uint32_t range, uint64_t seed, int n_threads) {
+    require("valid array", a != NULL || n == 0);
+    require("valid thread count", 1 <= n_threads && n_threads <= PSORT_THREADS_MAX);
+    ParallelFill* f = xmalloc(sizeof(ParallelFill));
+    *f = (ParallelFill){.a = a, .n = n, .range = range, .seed = seed};
+    long int n_segments = (long int)((n + PSORT_FILL_BLOCK_SIZE - 1) / PSORT_FILL_BLOCK_SIZE);
+    n_threads = block_threads(n, PSORT_FILL_BLOCK_SIZE, n_threads);
+    psort_split_blocks(&f->b, 0, n_segments, n_threads);
+    psort_run_on_blocks(f, n_threads, fill_block);
+    free(f);
+}
+
+typedef struct {
+    PSortBlocks b;
+    const int* a;
+    size_t n;
+    bool sorted[PSORT_THREADS_MAX];
+    uint64_t checksum[PSORT_THREADS_MAX];
+} ParallelCheck;
+
+static void* check_block(void* arg) {
+    PSortBlockArg* ba = arg;
+    ParallelCheck* c = ba->shared;
+    PSortRange r = c->b.blocks[ba->t];
+    const int* a = c->a;
+    // includes the first element of the next block
+    long int last = (size_t)r.end < c->n ? r.end : r.end - 1;
+    bool sorted = true;
+    uint64_t checksum = 0;
+    for (long int i = r.begin; i < last; i++) sorted &= a[i] <= a[i + 1];
+    for (long int i = r.begin; i < r.end; i++) checksum += mix64((uint32_t)a[i]);
+    c->sorted[ba->t] = sorted;
+    c->checksum[ba->t] = checksum;
+    return NULL;
+}
+
+// Returns whether a[0..n-1] is sorted in ascending order, using up to n_threads
+// threads. If checksum is not NULL, also sets it to a checksum of the elements
+// that does not depend on their order.
+bool psort_check_int(const int* a, size_t n, int n_threads, uint64_t* checksum) {
+    require("valid array", a != NULL || n == 0);
+    require("valid thread count", 1 <= n_threads && n_threads <= PSORT_THREADS_MAX);
+    ParallelCheck* c = xmalloc(sizeof(ParallelCheck));
+    c->a = a;
+    c->n = n;
+    n_threads = block_threads(n, PSORT_FILL_BLOCK_SIZE, n_threads);
+    psort_split_blocks(&c->b, 0, (long int)n, n_threads);
+    psort_run_on_blocks(c, n_threads, check_block);
+    bool sorted = true;
+    uint64_t sum = 0;
+    for (int t = 0; t < n_threads; t++) {
+        sorted &= c->sorted[t];
+        sum += c->checksum[t];
+    }
+    free(c);
+    if (checksum != NULL) *checksum = sum;
+    return sorted;
+}
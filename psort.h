@@ -0,0 +1,963 @@
+/*
+@author: Michael Rohs
+@date: October 17, 2026
+*/
+
+#ifndef psort_h_INCLUDED
+#define psort_h_INCLUDED
+
+#include <stdint.h>
+#include <limits.h>
+#include "util.h"
+#include "uchan.h"
+#include "countdown.h"
+#include "partition.h"
+#include "sortnet.h"
+
+#define PSORT_THREADS_MAX 256
+#define PSORT_GRAIN_SIZE 32
+#define PSORT_PARALLEL_PARTITION_SIZE 100000
+#define PSORT_INSERTION_SIZE 16
+#define PSORT_NINTHER_SIZE 128
+#define PSORT_EQUAL_PROBES 8
+#define PSORT_MAX_RUNS 64
+#define PSORT_PARTIAL_INSERTION_LIMIT 8
+#define PSORT_MAX_DROP_SHARE 8
+#define PSORT_DROP_SLACK 16
+#define PSORT_DROP_BACKTRACK 4
+#define PSORT_PARALLEL_MERGE_SIZE 100000
+#define PSORT_SAMPLE_LOG_BUCKETS 8
+#define PSORT_SAMPLE_BUCKETS (1 << PSORT_SAMPLE_LOG_BUCKETS)
+#define PSORT_OVERSAMPLING 16
+#define PSORT_SAMPLESORT_MIN_SIZE (1 << 16)
+#define PSORT_RADIX_BITS 8
+#define PSORT_RADIX_BUCKETS (1 << PSORT_RADIX_BITS)
+#define PSORT_RADIX_WC_BYTES 128
+#define PSORT_RADIX_MIN_SIZE (1 << 16)
+#define PSORT_RADIX_BLOCK_SIZE (1 << 16)
+#define PSORT_BATCH_CHUNK_SIZE (1 << 14)
+#define PSORT_BATCH_LARGE_SIZE (1 << 17)
+#define PSORT_GATHER_BLOCK_SIZE (1 << 16)
+#define PSORT_FILL_BLOCK_SIZE (1 << 16)
+
+typedef enum {
+    PSORT_AUTO, // picks the algorithm based on the element type and size
+    PSORT_QUICKSORT,
+    PSORT_MERGESORT, // stable, needs a scratch buffer of n elements
+    PSORT_SAMPLESORT, // needs a scratch buffer of n elements
+    PSORT_RADIXSORT, // stable, needs a scratch buffer of n elements, quicksort for non-integer keys
+} PSortAlgorithm;
+
+// Configures a parallel sort. A NULL options pointer means psort_options().
+typedef struct PSortOptions PSortOptions;
+struct PSortOptions {
+    int n_threads; // number of worker threads
+    long int grain_size; // intervals with fewer elements are sorted sequentially
+    PSortAlgorithm algorithm;
+    const PartitionScheme* scheme; // for int keys, NULL means partition_simd
+    bool fat_pivot; // whether keys equal to the pivot are excluded from recursion
+    bool adaptive; // whether presorted runs are detected and merged
+};
+
+PSortOptions psort_options(void);
+PSortOptions psort_resolve_options(const PSortOptions* opts);
+
+// Represents a key/value pair that is sorted by key.
+typedef struct PSortKV PSortKV;
+struct PSortKV {
+    uint64_t key;
+    uint64_t value;
+};
+
+typedef int (*PSortCompare)(const void* x, const void* y);
+
+void psort(void* base, size_t n, size_t elem_size, PSortCompare cmp, const PSortOptions* opts);
+void psort_int(int* a, size_t n, const PSortOptions* opts);
+void psort_float(float* a, size_t n, const PSortOptions* opts);
+void psort_uint64(uint64_t* a, size_t n, const PSortOptions* opts);
+void psort_kv(PSortKV* a, size_t n, const PSortOptions* opts);
+
+void psort_select(void* base, size_t n, size_t elem_size, size_t k, PSortCompare cmp, const PSortOptions* opts);
+void psort_int_select(int* a, size_t n, size_t k, const PSortOptions* opts);
+void psort_float_select(float* a, size_t n, size_t k, const PSortOptions* opts);
+void psort_uint64_select(uint64_t* a, size_t n, size_t k, const PSortOptions* opts);
+void psort_kv_select(PSortKV* a, size_t n, size_t k, const PSortOptions* opts);
+
+void psort_partial_sort(void* base, size_t n, size_t elem_size, size_t k, PSortCompare cmp, const PSortOptions* opts);
+void psort_int_partial_sort(int* a, size_t n, size_t k, const PSortOptions* opts);
+void psort_float_partial_sort(float* a, size_t n, size_t k, const PSortOptions* opts);
+void psort_uint64_partial_sort(uint64_t* a, size_t n, size_t k, const PSortOptions* opts);
+void psort_kv_partial_sort(PSortKV* a, size_t n, size_t k, const PSortOptions* opts);
+
+size_t psort_top_k(UChan* ch, void** top, size_t k, PSortCompare cmp, void (*discard)(void* x));
+
+void psort_int_batch(int** arrays, const size_t* lengths, size_t n_arrays, const PSortOptions* opts);
+void psort_float_batch(float** arrays, const size_t* lengths, size_t n_arrays, const PSortOptions* opts);
+void psort_uint64_batch(uint64_t** arrays, const size_t* lengths, size_t n_arrays, const PSortOptions* opts);
+void psort_kv_batch(PSortKV** arrays, const size_t* lengths, size_t n_arrays, const PSortOptions* opts);
+
+void psort_argsort(const void* base, size_t n, size_t elem_size, PSortCompare cmp, size_t* perm, const PSortOptions* opts);
+void psort_argsort_int(const int* keys, size_t n, size_t* perm, const PSortOptions* opts);
+void psort_argsort_float(const float* keys, size_t n, size_t* perm, const PSortOptions* opts);
+void psort_argsort_uint64(const uint64_t* keys, size_t n, size_t* perm, const PSortOptions* opts);
+void psort_gather(void* dst, const void* src, size_t elem_size, const size_t* perm, size_t n, const PSortOptions* opts);
+void psort_permute_columns(void** columns, const size_t* elem_sizes, int n_columns, const size_t* perm, size_t n, const PSortOptions* opts);
+
+void psort_fill_random_int(int* a, size_t n, uint32_t range, uint64_t seed, int n_threads);
+bool psort_check_int(const int* a, size_t n, int n_threads, uint64_t* checksum);
+
+// Radix keys for generate_psort_radix. They map the keys to unsigned integers of
+// the same order.
+#define psort_key_int(x) ((uint32_t)(x) ^ 0x80000000u)
+#define psort_key_uint64(x) (x)
+#define psort_key_kv(x) ((x).key)
+
+// Comparators for generate_psort. NaNs are greater than all other floats.
+#define psort_less(x, y) ((x) < (y))
+#define psort_less_float(x, y) ((x) < (y) || ((y) != (y) && (x) == (x)))
+#define psort_less_key(x, y) ((x).key < (y).key)
+
+/*
+The following declarations support the code that generate_psort expands to.
+They do not depend on the element type.
+*/
+
+// Represents an index range [begin, end) (end exclusive).
+typedef struct {
+    long int begin, end;
+} PSortRange;
+
+// A task of a PSortPool, which is passed by value through the pool's channel. A
+// pool thread calls run(t). The meaning of the other fields is up to run.
+typedef struct PSortTask PSortTask;
+struct PSortTask {
+    void (*run)(const PSortTask* t);
+    void* shared; // state that the tasks of a sort or a block operation share
+    long int low, high; // an interval with inclusive boundaries, or a block index
+    long int depth; // the number of leading bytes that the strings share (strsort)
+    int budget; // the number of unbalanced splits that are still allowed
+};
+
+// A set of threads that run PSortTasks until the pool is freed. The quicksort
+// creates one pool per sort and runs both its intervals and its parallel
+// partitions on it, so it does not start threads while sorting.
+typedef struct PSortPool PSortPool;
+
+// The block structure of a parallel partition. Block t is partitioned by thread
+// t. The misplaced elements are then swapped pairwise: misplaced_left lists the
+// ranges of elements > p left of the split point, misplaced_right the ranges of
+// elements <= p right of it. Both contain the same number of elements in total.
+typedef struct {
+    int n_blocks;
+    PSortRange blocks[PSORT_THREADS_MAX];
+    long int splits[PSORT_THREADS_MAX]; // first element > p in each block
+    PSortRange misplaced_left[PSORT_THREADS_MAX];
+    PSortRange misplaced_right[PSORT_THREADS_MAX];
+    long int n_misplaced;
+} PSortBlocks;
+
+// A task of the parallel merge sort. If sort_run is set, the run [lo, hi) of the
+// array is sorted. Otherwise, output positions [d0, d1) of the merge of runs
+// [lo, mid) and [mid, hi) are produced. A run with mid = hi is copied. The runs
+// are read from the scratch buffer if from_scratch is set and from the array
+// otherwise. The output goes to the other buffer.
+typedef struct {
+    long int lo, mid, hi;
+    long int d0, d1;
+    bool sort_run;
+    bool from_scratch;
+} PSortMergeTask;
+
+typedef struct {
+    void* shared; // starts with a PSortBlocks
+    int t; // thread index
+} PSortBlockArg;
+
+typedef void (*PSortBatchFunc)(void* a, size_t n, const PSortOptions* opts);
+
+int psort_split_budget(long int n);
+bool psort_is_unbalanced(long int n, long int n_left, long int n_right);
+PSortPool* psort_pool_new(int n_threads);
+void psort_pool_free(PSortPool* pool);
+int psort_pool_size(PSortPool* pool);
+void psort_pool_send(PSortPool* pool, PSortTask t);
+void psort_run_on_pool(PSortPool* pool, void* shared, int n_blocks, void* (*f)(void*));
+void psort_split_blocks(PSortBlocks* b, long int begin, long int end, int n_blocks);
+long int psort_collect_misplaced(PSortBlocks* b);
+void psort_misplaced_share(PSortBlocks* b, int t, long int* from, long int* to);
+void psort_skip_empty_ranges(PSortRange* ranges, int* r, long int* offset);
+void psort_run_on_blocks(void* shared, int n_blocks, void* (*f)(void*));
+void psort_start_workers(pthread_t* threads, int n_threads, void* (*f)(void*), void* arg);
+void psort_stop_workers(pthread_t* threads, int n_threads, UChan* ch_work);
+void psort_send_merge_task(UChan* ch, PSortMergeTask t);
+bool psort_receive_merge_task(UChan* ch, PSortMergeTask* t);
+int psort_send_merge_tasks(UChan* ch, long int* bounds, int n_runs, long int chunk, bool from_scratch);
+uint64_t psort_random(uint64_t* state);
+void psort_bucket_offsets(long int* counts, int n_threads, int k, PSortRange* buckets);
+bool psort_is_single_bucket(const PSortRange* buckets, int k, long int n);
+void psort_parallel_copy(void* dst, const void* src, size_t n_bytes, int n_threads);
+void psort_pool_copy(PSortPool* pool, void* dst, const void* src, size_t n_bytes, int n_blocks);
+void psort_run_batch(void** arrays, const size_t* lengths, size_t n_arrays, PSortBatchFunc sort, const PSortOptions* opts);
+
+/*
+Generates a parallel sort for arrays of type T, as well as selection and partial
+sorting:
+
+    void name(T* a, size_t n, const PSortOptions* opts);
+    void name##_select(T* a, size_t n, size_t k, const PSortOptions* opts);
+    void name##_partial_sort(T* a, size_t n, size_t k, const PSortOptions* opts);
+
+name##_select rearranges a such that a[k] is the element that would be at
+position k after sorting, with no greater elements before it and no smaller
+elements after it. name##_partial_sort moves the k smallest elements to
+a[0..k-1] in sorted order. Both partition like the quicksort, but only continue
+with the part that contains position k.
+
+less(x, y) is an expression or function that is true iff x is ordered before y.
+It has to be a strict weak ordering. As the generated code calls it directly, it
+is inlined into the partitioning and insertion sort loops.
+
+generate_psort_with additionally takes the kernels. partition_le rearranges the
+range [begin, end) of a, such that the elements that are not greater than p come
+first. It returns the index of the first element that is greater than p.
+partition_lt does the same for the elements less than p. small_sort(a, n) sorts
+slices of up to small_size elements, at which partitioning and merging stop. It
+has to be stable for the merge sort to be stable. generate_psort uses the scalar
+kernels that are generated by generate_psort_kernels, with insertion sort for
+slices of up to PSORT_INSERTION_SIZE elements.
+The merge sort (PSORT_MERGESORT) and the classification of the sample sort
+(PSORT_SAMPLESORT) only use less.
+With opts->adaptive, every algorithm first scans for presorted runs (see
+psort.c), which is stable, so the merge sort stays stable. The drop-merge sort
+for nearly sorted input is not stable and is skipped by the merge sort and the
+radix sort.
+*/
+#define generate_psort(name, T, less)\
+generate_psort_kernels(name, T, less)\
+generate_psort_with(name, T, less, name##_partition_le, name##_partition_lt, name##_insertion_sort, PSORT_INSERTION_SIZE)
+
+#define generate_psort_kernels(name, T, less)\
+static void name##_insertion_sort(T* a, long int n) {\
+    for (long int i = 1; i < n; i++) {\
+        T x = a[i];\
+        long int j = i - 1;\
+        while (j >= 0 && less(x, a[j])) {\
+            a[j + 1] = a[j];\
+            j--;\
+        }\
+        a[j + 1] = x;\
+    }\
+}\
+static long int name##_partition_le(const PSortOptions* opts, T* a, long int begin, long int end, T p) {\
+    (void)opts;\
+    long int i = begin, j = end - 1;\
+    while (true) {\
+        while (i <= j && !less(p, a[i])) i++;\
+        while (i <= j && less(p, a[j])) j--;\
+        if (i > j) break;\
+        T h = a[i]; a[i] = a[j]; a[j] = h;\
+        i++; j--;\
+    }\
+    return i;\
+}\
+static long int name##_partition_lt(const PSortOptions* opts, T* a, long int begin, long int end, T p) {\
+    (void)opts;\
+    long int i = begin, j = end - 1;\
+    while (true) {\
+        while (i <= j && less(a[i], p)) i++;\
+        while (i <= j && !less(a[j], p)) j--;\
+        if (i > j) break;\
+        T h = a[i]; a[i] = a[j]; a[j] = h;\
+        i++; j--;\
+    }\
+    return i;\
+}
+
+#define generate_psort_with(name, T, less, partition_le, partition_lt, small_sort, small_size)\
+static void name##_sift_down(T* h, long int i, long int n) {\
+    T x = h[i];\
+    while (true) {\
+        long int c = 2 * i + 1;\
+        if (c >= n) break;\
+        if (c + 1 < n && less(h[c], h[c + 1])) c++;\
+        if (!less(x, h[c])) break;\
+        h[i] = h[c];\
+        i = c;\
+    }\
+    h[i] = x;\
+}\
+static void name##_heapsort(T* a, long int low, long int high) {\
+    T* h = a + low;\
+    long int n = high - low + 1;\
+    for (long int i = n / 2 - 1; i >= 0; i--) name##_sift_down(h, i, n);\
+    for (long int end = n - 1; end > 0; end--) {\
+        T x = h[0];\
+        h[0] = h[end];\
+        h[end] = x;\
+        name##_sift_down(h, 0, end);\
+    }\
+}\
+static long int name##_median3(T* a, long int i, long int j, long int k) {\
+    if (less(a[i], a[j])) {\
+        if (less(a[j], a[k])) return j;\
+        return less(a[i], a[k]) ? k : i;\
+    } else {\
+        if (less(a[i], a[k])) return i;\
+        return less(a[j], a[k]) ? k : j;\
+    }\
+}\
+static long int name##_pivot_index(T* a, long int low, long int high) {\
+    long int n = high - low + 1;\
+    long int mid = low + n / 2;\
+    if (n < 3) return low;\
+    if (n < PSORT_NINTHER_SIZE) return name##_median3(a, low, mid, high);\
+    long int s = n / 8;\
+    long int m1 = name##_median3(a, low, low + s, low + 2 * s);\
+    long int m2 = name##_median3(a, mid - s, mid, mid + s);\
+    long int m3 = name##_median3(a, high - 2 * s, high - s, high);\
+    return name##_median3(a, m1, m2, m3);\
+}\
+typedef struct {\
+    PSortBlocks b;\
+    T* a;\
+    T p;\
+    const PSortOptions* opts;\
+} name##_ParallelPartition;\
+static void* name##_partition_block(void* arg) {\
+    PSortBlockArg* ba = arg;\
+    name##_ParallelPartition* pp = ba->shared;\
+    PSortRange r = pp->b.blocks[ba->t];\
+    pp->b.splits[ba->t] = partition_le(pp->opts, pp->a, r.begin, r.end, pp->p);\
+    return NULL;\
+}\
+static void* name##_swap_misplaced(void* arg) {\
+    PSortBlockArg* ba = arg;\
+    name##_ParallelPartition* pp = ba->shared;\
+    long int from, to;\
+    psort_misplaced_share(&pp->b, ba->t, &from, &to);\
+    int rl = 0, rr = 0;\
+    long int off_l = from, off_r = from;\
+    for (long int x = from; x < to; x++) {\
+        psort_skip_empty_ranges(pp->b.misplaced_left, &rl, &off_l);\
+        psort_skip_empty_ranges(pp->b.misplaced_right, &rr, &off_r);\
+        long int i = pp->b.misplaced_left[rl].begin + off_l;\
+        long int j = pp->b.misplaced_right[rr].begin + off_r;\
+        T h = pp->a[i];\
+        pp->a[i] = pp->a[j];\
+        pp->a[j] = h;\
+        off_l++; off_r++;\
+    }\
+    return NULL;\
+}\
+static long int name##_partition_parallel(const PSortOptions* opts, T* a, long int begin, long int end, T p, PSortPool* pool) {\
+    name##_ParallelPartition pp = {.a = a, .p = p, .opts = opts};\
+    int n_blocks = psort_pool_size(pool);\
+    psort_split_blocks(&pp.b, begin, end, n_blocks);\
+    psort_run_on_pool(pool, &pp, n_blocks, name##_partition_block);\
+    long int m = psort_collect_misplaced(&pp.b);\
+    if (pp.b.n_misplaced > 0) psort_run_on_pool(pool, &pp, n_blocks, name##_swap_misplaced);\
+    return m;\
+}\
+static long int name##_gather_equal(const PSortOptions* opts, T* a, long int low, long int j) {\
+    T p = a[j];\
+    long int n = j - low;\
+    bool found = false;\
+    for (int k = 0; k < PSORT_EQUAL_PROBES && !found; k++) {\
+        found = !less(a[low + n * k / PSORT_EQUAL_PROBES], p);\
+    }\
+    if (n == 0 || !found) return j;\
+    return partition_lt(opts, a, low, j, p);\
+}\
+static long int name##_partition(const PSortOptions* opts, T* a, long int low, long int high, PSortPool* pool, long int* lt) {\
+    long int pi = name##_pivot_index(a, low, high);\
+    T p = a[pi];\
+    a[pi] = a[low];\
+    a[low] = p;\
+    long int m = pool != NULL && high - low >= psort_pool_size(pool)\
+        ? name##_partition_parallel(opts, a, low + 1, high + 1, p, pool)\
+        : partition_le(opts, a, low + 1, high + 1, p);\
+    long int j = m - 1;\
+    a[low] = a[j];\
+    a[j] = p;\
+    *lt = opts->fat_pivot ? name##_gather_equal(opts, a, low, j) : j;\
+    return j;\
+}\
+static bool name##_partial_insertion_sort(T* a, long int low, long int high) {\
+    long int moves = 0;\
+    for (long int i = low + 1; i <= high; i++) {\
+        if (!less(a[i], a[i - 1])) continue;\
+        T x = a[i];\
+        long int j = i;\
+        do {\
+            a[j] = a[j - 1];\
+            j--;\
+            moves++;\
+        } while (j > low && less(x, a[j - 1]) && moves <= PSORT_PARTIAL_INSERTION_LIMIT);\
+        a[j] = x;\
+        if (moves > PSORT_PARTIAL_INSERTION_LIMIT) return false;\
+    }\
+    return true;\
+}\
+static bool name##_try_insertion_sort(const PSortOptions* opts, T* a, long int low, long int high) {\
+    long int q = (high - low) / 4;\
+    if (!opts->adaptive || less(a[low + q], a[low]) || less(a[low + 2 * q], a[low + q])\
+        || less(a[high - q], a[low + 2 * q]) || less(a[high], a[high - q])) return false;\
+    return name##_partial_insertion_sort(a, low, high);\
+}\
+static void name##_sort_sequential(const PSortOptions* opts, T* a, long int low, long int high, int budget) {\
+    while (high - low + 1 > small_size) {\
+        if (budget <= 0) {\
+            name##_heapsort(a, low, high);\
+            return;\
+        }\
+        if (name##_try_insertion_sort(opts, a, low, high)) return;\
+        long int lt;\
+        long int p = name##_partition(opts, a, low, high, NULL, &lt);\
+        if (psort_is_unbalanced(high - low + 1, lt - low, high - p)) budget--;\
+        if (lt - low < high - p) {\
+            name##_sort_sequential(opts, a, low, lt - 1, budget);\
+            low = p + 1;\
+        } else {\
+            name##_sort_sequential(opts, a, p + 1, high, budget);\
+            high = lt - 1;\
+        }\
+    }\
+    small_sort(a + low, high - low + 1);\
+    ensure("sorted", forall_x(long int k = low, k < high, k++, !less(a[k + 1], a[k])));\
+}\
+typedef struct {\
+    T* a;\
+    PSortPool* pool;\
+    Countdown* c;\
+    const PSortOptions* opts;\
+} name##_Args;\
+static void name##_run_interval(const PSortTask* t);\
+static void name##_schedule(name##_Args* s, long int low, long int high, int budget) {\
+    long int n = high - low + 1;\
+    if (n <= 0) return;\
+    if (n == 1 || n < s->opts->grain_size || budget <= 0) {\
+        name##_sort_sequential(s->opts, s->a, low, high, budget);\
+        countdown_sub(s->c, n);\
+        return;\
+    }\
+    psort_pool_send(s->pool, (PSortTask){.run = name##_run_interval, .shared = s, .low = low, .high = high, .budget = budget});\
+}\
+static void name##_run_interval(const PSortTask* t) {\
+    name##_Args* s = t->shared;\
+    long int low = t->low, high = t->high;\
+    long int n = high - low + 1;\
+    PSortPool* pool = n >= PSORT_PARALLEL_PARTITION_SIZE && countdown_get(s->c) == n ? s->pool : NULL;\
+    if (pool == NULL && name##_try_insertion_sort(s->opts, s->a, low, high)) {\
+        countdown_sub(s->c, n);\
+        return;\
+    }\
+    long int lt;\
+    long int p = name##_partition(s->opts, s->a, low, high, pool, &lt);\
+    countdown_sub(s->c, p - lt + 1);\
+    int budget = t->budget;\
+    if (psort_is_unbalanced(n, lt - low, high - p)) budget--;\
+    name##_schedule(s, low, lt - 1, budget);\
+    name##_schedule(s, p + 1, high, budget);\
+}\
+static void name##_quicksort_ranges(PSortPool* pool, Countdown* c, T* a, const PSortRange* ranges, int n_ranges, const PSortOptions* opts) {\
+    name##_Args s = {a, pool, c, opts};\
+    for (int r = 0; r < n_ranges; r++) {\
+        long int len = ranges[r].end - ranges[r].begin;\
+        name##_schedule(&s, ranges[r].begin, ranges[r].end - 1, psort_split_budget(len));\
+    }\
+    countdown_wait(c);\
+}\
+static void name##_quicksort(T* a, long int n, const PSortOptions* opts) {\
+    if (opts->n_threads == 1 || n < opts->grain_size) {\
+        name##_sort_sequential(opts, a, 0, n - 1, psort_split_budget(n));\
+        return;\
+    }\
+    PSortPool* pool = psort_pool_new(opts->n_threads);\
+    Countdown* c = countdown_new(n);\
+    PSortRange all = {0, n};\
+    name##_quicksort_ranges(pool, c, a, &all, 1, opts);\
+    psort_pool_free(pool);\
+    countdown_free(c);\
+}\
+static void name##_merge(T* dst, const T* a, long int na, const T* b, long int nb) {\
+    long int i = 0, j = 0, k = 0;\
+    while (i < na && j < nb) {\
+        if (less(b[j], a[i])) dst[k++] = b[j++];\
+        else dst[k++] = a[i++];\
+    }\
+    while (i < na) dst[k++] = a[i++];\
+    while (j < nb) dst[k++] = b[j++];\
+}\
+static void name##_mergesort_sequential(T* a, T* tmp, long int n) {\
+    if (n <= small_size) {\
+        small_sort(a, n);\
+        return;\
+    }\
+    long int h = n / 2;\
+    name##_mergesort_sequential(a, tmp, h);\
+    name##_mergesort_sequential(a + h, tmp + h, n - h);\
+    if (!less(a[h], a[h - 1])) return;\
+    memcpy(tmp, a, h * sizeof(T));\
+    name##_merge(a, tmp, h, a + h, n - h);\
+}\
+static long int name##_merge_path(const T* a, long int na, const T* b, long int nb, long int d) {\
+    long int lo = d > nb ? d - nb : 0;\
+    long int hi = d < na ? d : na;\
+    while (lo < hi) {\
+        long int mid = lo + (hi - lo) / 2;\
+        if (less(b[d - mid - 1], a[mid])) hi = mid;\
+        else lo = mid + 1;\
+    }\
+    return lo;\
+}\
+typedef struct {\
+    T* a;\
+    T* scratch;\
+    UChan* ch_work;\
+    Countdown* c;\
+} name##_MergeArgs;\
+static void* name##_merge_worker(void* arg) {\
+    name##_MergeArgs* s = arg;\
+    PSortMergeTask t;\
+    while (psort_receive_merge_task(s->ch_work, &t)) {\
+        if (t.sort_run) {\
+            name##_mergesort_sequential(s->a + t.lo, s->scratch + t.lo, t.hi - t.lo);\
+            countdown_sub(s->c, t.hi - t.lo);\
+            continue;\
+        }\
+        T* src = t.from_scratch ? s->scratch : s->a;\
+        T* dst = t.from_scratch ? s->a : s->scratch;\
+        T* a = src + t.lo;\
+        T* b = src + t.mid;\
+        long int na = t.mid - t.lo, nb = t.hi - t.mid;\
+        long int i0 = name##_merge_path(a, na, b, nb, t.d0);\
+        long int i1 = name##_merge_path(a, na, b, nb, t.d1);\
+        name##_merge(dst + t.lo + t.d0, a + i0, i1 - i0, b + (t.d0 - i0), (t.d1 - i1) - (t.d0 - i0));\
+        countdown_sub(s->c, t.d1 - t.d0);\
+    }\
+    return NULL;\
+}\
+static void name##_merge_runs_sequential(T* a, T* scratch, long int* bounds, int n_runs) {\
+    long int n = bounds[n_runs];\
+    T* src = a;\
+    T* dst = scratch;\
+    while (n_runs > 1) {\
+        int m = 0;\
+        for (int r = 0; r < n_runs; r += 2) {\
+            long int lo = bounds[r], mid = bounds[r + 1];\
+            long int hi = r + 1 < n_runs ? bounds[r + 2] : mid;\
+            name##_merge(dst + lo, src + lo, mid - lo, src + mid, hi - mid);\
+            bounds[m++] = lo;\
+        }\
+        bounds[m] = n;\
+        n_runs = m;\
+        T* h = src;\
+        src = dst;\
+        dst = h;\
+    }\
+    if (src != a) memcpy(a, src, n * sizeof(T));\
+}\
+static void name##_merge_runs_parallel(T* a, T* scratch, long int* bounds, int n_runs, bool sort_runs, const PSortOptions* opts) {\
+    long int n = bounds[n_runs];\
+    int n_threads = opts->n_threads;\
+    UChan* ch_work = uchan_new_sized(sizeof(PSortMergeTask));\
+    Countdown* c = countdown_new(n);\
+    name##_MergeArgs s = {a, scratch, ch_work, c};\
+    pthread_t threads[n_threads];\
+    psort_start_workers(threads, n_threads, name##_merge_worker, &s);\
+    if (sort_runs) {\
+        for (int r = 0; r < n_runs; r++) {\
+            psort_send_merge_task(ch_work, (PSortMergeTask){.lo = bounds[r], .hi = bounds[r + 1], .sort_run = true});\
+        }\
+        countdown_wait(c);\
+    }\
+    long int chunk = (n + n_threads - 1) / n_threads;\
+    if (chunk < opts->grain_size) chunk = opts->grain_size;\
+    bool from_scratch = false;\
+    while (n_runs > 1 || from_scratch) {\
+        countdown_set(c, n);\
+        n_runs = psort_send_merge_tasks(ch_work, bounds, n_runs, chunk, from_scratch);\
+        countdown_wait(c);\
+        from_scratch = !from_scratch;\
+    }\
+    psort_stop_workers(threads, n_threads, ch_work);\
+    countdown_free(c);\
+    uchan_free(ch_work);\
+}\
+static void name##_mergesort(T* a, long int n, const PSortOptions* opts) {\
+    T* scratch = xmalloc(n * sizeof(T));\
+    int n_threads = opts->n_threads;\
+    if (n_threads == 1 || n < opts->grain_size) {\
+        name##_mergesort_sequential(a, scratch, n);\
+    } else {\
+        long int bounds[n_threads + 1];\
+        long int run = (n + n_threads - 1) / n_threads;\
+        int n_runs = 0;\
+        for (long int lo = 0; lo < n; lo += run) bounds[n_runs++] = lo;\
+        bounds[n_runs] = n;\
+        name##_merge_runs_parallel(a, scratch, bounds, n_runs, true, opts);\
+    }\
+    free(scratch);\
+}\
+static void name##_reverse(T* a, long int begin, long int end) {\
+    for (long int i = begin, j = end - 1; i < j; i++, j--) {\
+        T h = a[i];\
+        a[i] = a[j];\
+        a[j] = h;\
+    }\
+}\
+static int name##_find_runs(T* a, long int n, long int* bounds, int max_runs) {\
+    int n_runs = 0;\
+    long int i = 0;\
+    while (i < n) {\
+        if (n_runs == max_runs) return -1;\
+        bounds[n_runs++] = i;\
+        long int j = i + 1;\
+        if (j < n && less(a[j], a[i])) {\
+            while (j < n && less(a[j], a[j - 1])) j++;\
+            name##_reverse(a, i, j);\
+        } else {\
+            while (j < n && !less(a[j], a[j - 1])) j++;\
+        }\
+        i = j;\
+    }\
+    bounds[n_runs] = n;\
+    return n_runs;\
+}\
+static bool name##_drop_merge(T* a, long int n, const PSortOptions* opts) {\
+    long int max_drops = n / PSORT_MAX_DROP_SHARE + PSORT_DROP_SLACK;\
+    T* drops = xmalloc(max_drops * sizeof(T));\
+    long int w = 0, d = 0;\
+    for (long int i = 0; i < n; i++) {\
+        T x = a[i];\
+        if (w == 0 || !less(x, a[w - 1])) {\
+            a[w++] = x;\
+            continue;\
+        }\
+        if (d + PSORT_DROP_BACKTRACK > i / PSORT_MAX_DROP_SHARE + PSORT_DROP_SLACK) {\
+            memcpy(a + w, drops, d * sizeof(T));\
+            free(drops);\
+            return false;\
+        }\
+        long int k = 1;\
+        while (k <= PSORT_DROP_BACKTRACK && k < w && less(x, a[w - 1 - k])) k++;\
+        if (k > PSORT_DROP_BACKTRACK || k == w) {\
+            drops[d++] = x;\
+            continue;\
+        }\
+        for (long int m = 0; m < k; m++) drops[d++] = a[--w];\
+        a[w++] = x;\
+    }\
+    name##_quicksort(drops, d, opts);\
+    long int i = w - 1, j = d - 1;\
+    for (long int k = n - 1; j >= 0; k--) {\
+        if (i >= 0 && less(drops[j], a[i])) a[k] = a[i--];\
+        else a[k] = drops[j--];\
+    }\
+    free(drops);\
+    return true;\
+}\
+static bool name##_sort_presorted(T* a, long int n, const PSortOptions* opts) {\
+    if (!opts->adaptive || n <= small_size) return false;\
+    long int bounds[PSORT_MAX_RUNS + 1];\
+    int n_runs = name##_find_runs(a, n, bounds, PSORT_MAX_RUNS);\
+    if (n_runs < 0) {\
+        bool stable = opts->algorithm == PSORT_MERGESORT || opts->algorithm == PSORT_RADIXSORT;\
+        if (stable || !name##_drop_merge(a, n, opts)) return false;\
+        ensure("sorted", forall_x(long int k = 0, k < n - 1, k++, !less(a[k + 1], a[k])));\
+        return true;\
+    }\
+    if (n_runs > 1) {\
+        T* scratch = xmalloc(n * sizeof(T));\
+        if (opts->n_threads == 1 || n < PSORT_PARALLEL_MERGE_SIZE) {\
+            name##_merge_runs_sequential(a, scratch, bounds, n_runs);\
+        } else {\
+            name##_merge_runs_parallel(a, scratch, bounds, n_runs, false, opts);\
+        }\
+        free(scratch);\
+    }\
+    ensure("sorted", forall_x(long int k = 0, k < n - 1, k++, !less(a[k + 1], a[k])));\
+    return true;\
+}\
+typedef struct {\
+    PSortBlocks b;\
+    T* a;\
+    T* scratch;\
+    uint8_t* oracle;\
+    long int* counts;\
+    int log_k;\
+    T tree[PSORT_SAMPLE_BUCKETS];\
+} name##_SampleSort;\
+static void name##_build_tree(T* tree, const T* splitters, long int node, long int lo, long int hi, long int k) {\
+    if (node >= k) return;\
+    long int mid = lo + (hi - lo) / 2;\
+    tree[node] = splitters[mid];\
+    name##_build_tree(tree, splitters, 2 * node, lo, mid - 1, k);\
+    name##_build_tree(tree, splitters, 2 * node + 1, mid + 1, hi, k);\
+}\
+static void* name##_classify(void* arg) {\
+    PSortBlockArg* ba = arg;\
+    name##_SampleSort* ss = ba->shared;\
+    PSortRange r = ss->b.blocks[ba->t];\
+    const T* tree = ss->tree;\
+    const T* a = ss->a;\
+    int log_k = ss->log_k;\
+    long int k = 1L << log_k;\
+    long int* counts = ss->counts + ba->t * k;\
+    long int i = r.begin;\
+    for (; i + 4 <= r.end; i += 4) {\
+        long int j0 = 1, j1 = 1, j2 = 1, j3 = 1;\
+        for (int l = 0; l < log_k; l++) {\
+            j0 = 2 * j0 + less(tree[j0], a[i]);\
+            j1 = 2 * j1 + less(tree[j1], a[i + 1]);\
+            j2 = 2 * j2 + less(tree[j2], a[i + 2]);\
+            j3 = 2 * j3 + less(tree[j3], a[i + 3]);\
+        }\
+        ss->oracle[i] = (uint8_t)(j0 - k);\
+        ss->oracle[i + 1] = (uint8_t)(j1 - k);\
+        ss->oracle[i + 2] = (uint8_t)(j2 - k);\
+        ss->oracle[i + 3] = (uint8_t)(j3 - k);\
+        counts[j0 - k]++;\
+        counts[j1 - k]++;\
+        counts[j2 - k]++;\
+        counts[j3 - k]++;\
+    }\
+    for (; i < r.end; i++) {\
+        long int j = 1;\
+        for (int l = 0; l < log_k; l++) j = 2 * j + less(tree[j], a[i]);\
+        ss->oracle[i] = (uint8_t)(j - k);\
+        counts[j - k]++;\
+    }\
+    return NULL;\
+}\
+static void* name##_scatter(void* arg) {\
+    PSortBlockArg* ba = arg;\
+    name##_SampleSort* ss = ba->shared;\
+    PSortRange r = ss->b.blocks[ba->t];\
+    long int* offsets = ss->counts + ba->t * (1L << ss->log_k);\
+    for (long int i = r.begin; i < r.end; i++) {\
+        ss->scratch[offsets[ss->oracle[i]]++] = ss->a[i];\
+    }\
+    return NULL;\
+}\
+static void name##_samplesort(T* a, long int n, const PSortOptions* opts) {\
+    int n_threads = opts->n_threads;\
+    if (n_threads == 1 || n < PSORT_SAMPLESORT_MIN_SIZE) {\
+        name##_quicksort(a, n, opts);\
+        return;\
+    }\
+    int log_k = PSORT_SAMPLE_LOG_BUCKETS;\
+    long int k = 1L << log_k;\
+    long int n_sample = k * PSORT_OVERSAMPLING;\
+    T* sample = xmalloc(n_sample * sizeof(T));\
+    uint64_t state = 0x9e3779b97f4a7c15ULL ^ (uint64_t)n;\
+    for (long int i = 0; i < n_sample; i++) sample[i] = a[psort_random(&state) % (uint64_t)n];\
+    name##_sort_sequential(opts, sample, 0, n_sample - 1, psort_split_budget(n_sample));\
+    T splitters[PSORT_SAMPLE_BUCKETS];\
+    for (long int i = 0; i < k - 1; i++) splitters[i] = sample[(i + 1) * PSORT_OVERSAMPLING];\
+    free(sample);\
+    name##_SampleSort* ss = xmalloc(sizeof(name##_SampleSort));\
+    ss->a = a;\
+    ss->scratch = xmalloc(n * sizeof(T));\
+    ss->oracle = xmalloc(n);\
+    ss->counts = xcalloc(n_threads * k, sizeof(long int));\
+    ss->log_k = log_k;\
+    name##_build_tree(ss->tree, splitters, 1, 0, k - 2, k);\
+    PSortPool* pool = psort_pool_new(n_threads);\
+    psort_split_blocks(&ss->b, 0, n, n_threads);\
+    psort_run_on_pool(pool, ss, n_threads, name##_classify);\
+    PSortRange buckets[PSORT_SAMPLE_BUCKETS];\
+    psort_bucket_offsets(ss->counts, n_threads, (int)k, buckets);\
+    psort_run_on_pool(pool, ss, n_threads, name##_scatter);\
+    psort_pool_copy(pool, a, ss->scratch, n * sizeof(T), n_threads);\
+    Countdown* c = countdown_new(n);\
+    name##_quicksort_ranges(pool, c, a, buckets, (int)k, opts);\
+    psort_pool_free(pool);\
+    countdown_free(c);\
+    free(ss->counts);\
+    free(ss->oracle);\
+    free(ss->scratch);\
+    free(ss);\
+}\
+void name(T* a, size_t n, const PSortOptions* opts) {\
+    require("valid array", a != NULL || n == 0);\
+    require("not too long", n <= LONG_MAX);\
+    PSortOptions o = psort_resolve_options(opts);\
+    if (n < 2) return;\
+    if (name##_sort_presorted(a, (long int)n, &o)) return;\
+    switch (o.algorithm) {\
+        case PSORT_AUTO:\
+        case PSORT_QUICKSORT:\
+            name##_quicksort(a, (long int)n, &o);\
+            break;\
+        case PSORT_MERGESORT:\
+            name##_mergesort(a, (long int)n, &o);\
+            break;\
+        case PSORT_SAMPLESORT:\
+            name##_samplesort(a, (long int)n, &o);\
+            break;\
+        case PSORT_RADIXSORT:\
+            name##_quicksort(a, (long int)n, &o);\
+            break;\
+    }\
+}\
+void name##_select(T* a, size_t n, size_t k, const PSortOptions* opts) {\
+    require("valid array", a != NULL || n == 0);\
+    require("valid index", k < n);\
+    require("not too long", n <= LONG_MAX);\
+    PSortOptions o = psort_resolve_options(opts);\
+    bool parallel = o.n_threads > 1 && n >= PSORT_PARALLEL_PARTITION_SIZE;\
+    PSortPool* pool = parallel ? psort_pool_new(o.n_threads) : NULL;\
+    long int low = 0, high = (long int)n - 1;\
+    long int j = (long int)k;\
+    int budget = psort_split_budget((long int)n);\
+    while (high - low + 1 > small_size) {\
+        if (budget <= 0) {\
+            name##_heapsort(a, low, high);\
+            break;\
+        }\
+        long int len = high - low + 1;\
+        long int lt;\
+        long int p = name##_partition(&o, a, low, high, len >= PSORT_PARALLEL_PARTITION_SIZE ? pool : NULL, &lt);\
+        if (psort_is_unbalanced(len, lt - low, high - p)) budget--;\
+        if (j < lt) high = lt - 1;\
+        else if (j > p) low = p + 1;\
+        else break;\
+    }\
+    if (high - low + 1 <= small_size) small_sort(a + low, high - low + 1);\
+    psort_pool_free(pool);\
+}\
+void name##_partial_sort(T* a, size_t n, size_t k, const PSortOptions* opts) {\
+    require("valid count", k <= n);\
+    if (k == 0) return;\
+    if (k < n) name##_select(a, n, k - 1, opts);\
+    name(a, k, opts);\
+}
+
+/*
+Generates a parallel sort for arrays of type T that uses an LSD radix sort for
+large arrays and compare_sort (generated by generate_psort) otherwise:
+
+    void name(T* a, size_t n, const PSortOptions* opts);
+    void name##_select(T* a, size_t n, size_t k, const PSortOptions* opts);
+    void name##_partial_sort(T* a, size_t n, size_t k, const PSortOptions* opts);
+
+Selection uses compare_sort##_select. The partial sort sorts the selected
+elements with name.
+
+key(x) maps an element to an unsigned integer of type K, such that the order of
+the keys is the order of the elements. The radix sort is used for
+PSORT_RADIXSORT, and for PSORT_AUTO with at least PSORT_RADIX_MIN_SIZE elements.
+Presorted input is handled by the run detection of compare_sort in any case.
+*/
+#define generate_psort_radix(name, T, K, key, compare_sort)\
+typedef struct {\
+    PSortBlocks b;\
+    T* src;\
+    T* dst;\
+    int shift;\
+    long int* counts;\
+} name##_Radix;\
+static void* name##_radix_count(void* arg) {\
+    PSortBlockArg* ba = arg;\
+    name##_Radix* r = ba->shared;\
+    PSortRange b = r->b.blocks[ba->t];\
+    long int* counts = r->counts + ba->t * PSORT_RADIX_BUCKETS;\
+    memset(counts, 0, PSORT_RADIX_BUCKETS * sizeof(long int));\
+    for (long int i = b.begin; i < b.end; i++) {\
+        counts[(key(r->src[i]) >> r->shift) & (PSORT_RADIX_BUCKETS - 1)]++;\
+    }\
+    return NULL;\
+}\
+static void* name##_radix_scatter(void* arg) {\
+    PSortBlockArg* ba = arg;\
+    name##_Radix* r = ba->shared;\
+    PSortRange b = r->b.blocks[ba->t];\
+    long int* offsets = r->counts + ba->t * PSORT_RADIX_BUCKETS;\
+    int wc = sizeof(T) < PSORT_RADIX_WC_BYTES ? PSORT_RADIX_WC_BYTES / sizeof(T) : 1;\
+    T* buf = xmalloc(PSORT_RADIX_BUCKETS * wc * sizeof(T));\
+    int fill[PSORT_RADIX_BUCKETS] = {0};\
+    for (long int i = b.begin; i < b.end; i++) {\
+        T x = r->src[i];\
+        int d = (key(x) >> r->shift) & (PSORT_RADIX_BUCKETS - 1);\
+        buf[d * wc + fill[d]++] = x;\
+        if (fill[d] == wc) {\
+            memcpy(r->dst + offsets[d], buf + d * wc, wc * sizeof(T));\
+            offsets[d] += wc;\
+            fill[d] = 0;\
+        }\
+    }\
+    for (int d = 0; d < PSORT_RADIX_BUCKETS; d++) {\
+        memcpy(r->dst + offsets[d], buf + d * wc, fill[d] * sizeof(T));\
+        offsets[d] += fill[d];\
+    }\
+    free(buf);\
+    return NULL;\
+}\
+static void name##_radixsort(T* a, long int n, const PSortOptions* opts) {\
+    long int max_threads = n / PSORT_RADIX_BLOCK_SIZE;\
+    int n_threads = max_threads < 1 ? 1 : max_threads < opts->n_threads ? (int)max_threads : opts->n_threads;\
+    PSortPool* pool = n_threads > 1 ? psort_pool_new(n_threads - 1) : NULL;\
+    name##_Radix* r = xmalloc(sizeof(name##_Radix));\
+    r->src = a;\
+    r->dst = xmalloc(n * sizeof(T));\
+    r->counts = xmalloc(n_threads * PSORT_RADIX_BUCKETS * sizeof(long int));\
+    psort_split_blocks(&r->b, 0, n, n_threads);\
+    PSortRange buckets[PSORT_RADIX_BUCKETS];\
+    for (int shift = 0; shift < 8 * (int)sizeof(K); shift += PSORT_RADIX_BITS) {\
+        r->shift = shift;\
+        psort_run_on_pool(pool, r, n_threads, name##_radix_count);\
+        psort_bucket_offsets(r->counts, n_threads, PSORT_RADIX_BUCKETS, buckets);\
+        if (psort_is_single_bucket(buckets, PSORT_RADIX_BUCKETS, n)) continue;\
+        psort_run_on_pool(pool, r, n_threads, name##_radix_scatter);\
+        T* h = r->src;\
+        r->src = r->dst;\
+        r->dst = h;\
+    }\
+    if (r->src != a) {\
+        psort_pool_copy(pool, a, r->src, n * sizeof(T), n_threads);\
+        r->dst = r->src;\
+    }\
+    ensure("sorted", forall_x(long int k = 0, k < n - 1, k++, key(a[k]) <= key(a[k + 1])));\
+    psort_pool_free(pool);\
+    free(r->counts);\
+    free(r->dst);\
+    free(r);\
+}\
+void name(T* a, size_t n, const PSortOptions* opts) {\
+    PSortOptions o = psort_resolve_options(opts);\
+    bool radix = o.algorithm == PSORT_RADIXSORT || (o.algorithm == PSORT_AUTO && n >= PSORT_RADIX_MIN_SIZE);\
+    if (radix && n >= 2) {\
+        require_not_null(a);\
+        if (!compare_sort##_sort_presorted(a, (long int)n, &o)) name##_radixsort(a, (long int)n, &o);\
+    } else {\
+        compare_sort(a, n, &o);\
+    }\
+}\
+void name##_select(T* a, size_t n, size_t k, const PSortOptions* opts) {\
+    compare_sort##_select(a, n, k, opts);\
+}\
+void name##_partial_sort(T* a, size_t n, size_t k, const PSortOptions* opts) {\
+    require("valid count", k <= n);\
+    if (k == 0) return;\
+    if (k < n) compare_sort##_select(a, n, k - 1, opts);\
+    name(a, k, opts);\
+}
+
+/*
+Generates a batch sort for many independent arrays of type T, which are sorted
+with name (generated by generate_psort or generate_psort_radix):
+
+    void name##_batch(T** arrays, const size_t* lengths, size_t n_arrays, const PSortOptions* opts);
+
+See psort_run_batch.
+*/
+#define generate_psort_batch(name, T)\
+static void name##_batch_one(void* a, size_t n, const PSortOptions* opts) {\
+    name(a, n, opts);\
+}\
+void name##_batch(T** arrays, const size_t* lengths, size_t n_arrays, const PSortOptions* opts) {\
+    psort_run_batch((void**)arrays, lengths, n_arrays, name##_batch_one, opts);\
+}
+
+#endif // psort_h_INCLUDED
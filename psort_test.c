@@ -0,0 +1,605 @@
+#include <math.h>
+#include "psort.h"
+
+// Returns options for the given number of threads and grain size, such that
+// small test arrays still exercise the channel-based scheduling.
+PSortOptions options(int n_threads, int grain_size) {
+    PSortOptions opts = psort_options();
+    opts.n_threads = n_threads;
+    opts.grain_size = grain_size;
+    return opts;
+}
+
+int compare_int(const void* x, const void* y) {
+    int a = *(const int*)x, b = *(const int*)y;
+    return (a > b) - (a < b);
+}
+
+void test_int(void) {
+    char* names[] = {"hoare", "branchless", "simd"};
+    int ns[] = {0, 1, 2, 17, 1000, 200000};
+    for (int s = 0; s < 3; s++) {
+        for (int i = 0; i < sizeof(ns) / sizeof(ns[0]); i++) {
+            int n = ns[i];
+            int* a = xmalloc((n + 1) * sizeof(int));
+            int* b = xmalloc((n + 1) * sizeof(int));
+            for (int k = 0; k < n; k++) a[k] = i_rnd(n / 4 + 1) - n / 8;
+            memcpy(b, a, n * sizeof(int));
+            PSortOptions opts = options(4, 8);
+            opts.scheme = partition_scheme(names[s]);
+            psort_int(a, n, &opts);
+            qsort(b, n, sizeof(int), compare_int);
+            test_equal_i(memcmp(a, b, n * sizeof(int)), 0);
+            free(a);
+            free(b);
+        }
+    }
+}
+
+void test_float(void) {
+    int n = 50000;
+    float* a = xmalloc(n * sizeof(float));
+    for (int k = 0; k < n; k++) a[k] = k % 100 == 0 ? NAN : (float)i_rnd(1000) - 500.5f;
+    PSortOptions opts = options(3, 16);
+    psort_float(a, n, &opts);
+    // the NaNs come last
+    test_equal_i(forall(k, n - n / 100 - 1, a[k] <= a[k + 1]), true);
+    test_equal_i(forall_x(int k = n - n / 100, k < n, k++, isnan(a[k])), true);
+    free(a);
+}
+
+void test_uint64(void) {
+    int n = 300000;
+    uint64_t* a = xmalloc(n * sizeof(uint64_t));
+    for (int k = 0; k < n; k++) a[k] = ((uint64_t)i_rnd(1 << 30) << 33) ^ (uint64_t)i_rnd(1 << 30);
+    psort_uint64(a, n, NULL);
+    test_equal_i(forall(k, n - 1, a[k] <= a[k + 1]), true);
+    // all equal keys
+    for (int k = 0; k < n; k++) a[k] = UINT64_MAX;
+    psort_uint64(a, n, NULL);
+    test_equal_i(forall(k, n, a[k] == UINT64_MAX), true);
+    free(a);
+}
+
+void test_kv(void) {
+    int n = 100000;
+    PSortKV* a = xmalloc(n * sizeof(PSortKV));
+    for (int k = 0; k < n; k++) a[k] = (PSortKV){(uint64_t)i_rnd(1000), (uint64_t)k};
+    psort_kv(a, n, NULL);
+    test_equal_i(forall(k, n - 1, a[k].key <= a[k + 1].key), true);
+    // every value is still there exactly once
+    bool* seen = xcalloc(n, sizeof(bool));
+    for (int k = 0; k < n; k++) seen[a[k].value] = true;
+    test_equal_i(forall(k, n, seen[k]), true);
+    free(seen);
+    free(a);
+}
+
+// An element whose size is not a power of two.
+typedef struct {
+    int key;
+    char name[8];
+} Record;
+
+int compare_record(const void* x, const void* y) {
+    const Record* a = x;
+    const Record* b = y;
+    return (a->key > b->key) - (a->key < b->key);
+}
+
+void test_generic(void) {
+    int n = 20000;
+    Record* a = xmalloc(n * sizeof(Record));
+    for (int k = 0; k < n; k++) {
+        a[k].key = i_rnd(500);
+        snprintf(a[k].name, sizeof(a[k].name), "%d", a[k].key);
+    }
+    PSortOptions opts = options(4, 32);
+    psort(a, n, sizeof(Record), compare_record, &opts);
+    test_equal_i(forall(k, n - 1, a[k].key <= a[k + 1].key), true);
+    // the records have been moved as a whole
+    test_equal_i(forall(k, n, atoi(a[k].name) == a[k].key), true);
+    free(a);
+}
+
+// Equal keys keep their original order with the merge sort.
+void test_stable(void) {
+    int ns[] = {1, 5, 100, 1001, 77777};
+    int threads[] = {1, 3, 8};
+    for (int i = 0; i < sizeof(ns) / sizeof(ns[0]); i++) {
+        for (int t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+            int n = ns[i];
+            PSortKV* a = xmalloc(n * sizeof(PSortKV));
+            for (int k = 0; k < n; k++) a[k] = (PSortKV){(uint64_t)i_rnd(50), (uint64_t)k};
+            PSortOptions opts = options(threads[t], 8);
+            opts.algorithm = PSORT_MERGESORT;
+            psort_kv(a, n, &opts);
+            test_equal_i(forall(k, n - 1, a[k].key < a[k + 1].key ||
+                         (a[k].key == a[k + 1].key && a[k].value < a[k + 1].value)), true);
+            free(a);
+        }
+    }
+}
+
+void test_mergesort_generic(void) {
+    int n = 30000;
+    Record* a = xmalloc(n * sizeof(Record));
+    for (int k = 0; k < n; k++) {
+        a[k].key = i_rnd(100);
+        snprintf(a[k].name, sizeof(a[k].name), "%d", k);
+    }
+    PSortOptions opts = options(4, 32);
+    opts.algorithm = PSORT_MERGESORT;
+    psort(a, n, sizeof(Record), compare_record, &opts);
+    test_equal_i(forall(k, n - 1, a[k].key < a[k + 1].key ||
+                 (a[k].key == a[k + 1].key && atoi(a[k].name) < atoi(a[k + 1].name))), true);
+    free(a);
+}
+
+void test_samplesort(void) {
+    int ns[] = {1000, 100000, 300000};
+    int ks[] = {3, 1000, 1 << 30};
+    for (int i = 0; i < sizeof(ns) / sizeof(ns[0]); i++) {
+        for (int j = 0; j < sizeof(ks) / sizeof(ks[0]); j++) {
+            int n = ns[i];
+            int* a = xmalloc(n * sizeof(int));
+            for (int k = 0; k < n; k++) a[k] = i_rnd(ks[j]);
+            unsigned int sum = 0;
+            for (int k = 0; k < n; k++) sum += a[k];
+            PSortOptions opts = options(5, 32);
+            opts.algorithm = PSORT_SAMPLESORT;
+            psort_int(a, n, &opts);
+            test_equal_i(forall(k, n - 1, a[k] <= a[k + 1]), true);
+            for (int k = 0; k < n; k++) sum -= a[k];
+            test_equal_i(sum, 0);
+            free(a);
+        }
+    }
+    int n = 200000;
+    PSortKV* a = xmalloc(n * sizeof(PSortKV));
+    for (int k = 0; k < n; k++) a[k] = (PSortKV){(uint64_t)i_rnd(1 << 20) << 40, (uint64_t)k};
+    PSortOptions opts = options(4, 32);
+    opts.algorithm = PSORT_SAMPLESORT;
+    psort_kv(a, n, &opts);
+    test_equal_i(forall(k, n - 1, a[k].key <= a[k + 1].key), true);
+    free(a);
+}
+
+void test_radixsort(void) {
+    int ns[] = {2, 1000, 70000, 300000};
+    for (int i = 0; i < sizeof(ns) / sizeof(ns[0]); i++) {
+        int n = ns[i];
+        int* a = xmalloc(n * sizeof(int));
+        int* b = xmalloc(n * sizeof(int));
+        for (int k = 0; k < n; k++) a[k] = i_rnd(1 << 30) - (1 << 29) + (k % 3 == 0 ? INT_MIN / 2 : 0);
+        memcpy(b, a, n * sizeof(int));
+        PSortOptions opts = options(4, 32);
+        opts.algorithm = PSORT_RADIXSORT;
+        psort_int(a, n, &opts);
+        qsort(b, n, sizeof(int), compare_int);
+        test_equal_i(memcmp(a, b, n * sizeof(int)), 0);
+        free(a);
+        free(b);
+    }
+
+    // all digits but the lowest are equal, so most passes are skipped
+    int n = 100000;
+    uint64_t* u = xmalloc(n * sizeof(uint64_t));
+    for (int k = 0; k < n; k++) u[k] = 0xabcdef0000000000ULL | (uint64_t)i_rnd(256);
+    psort_uint64(u, n, NULL);
+    test_equal_i(forall(k, n - 1, u[k] <= u[k + 1]), true);
+    free(u);
+
+    // the radix sort is stable
+    PSortKV* kv = xmalloc(n * sizeof(PSortKV));
+    for (int k = 0; k < n; k++) kv[k] = (PSortKV){(uint64_t)i_rnd(1000) << 32, (uint64_t)k};
+    PSortOptions opts = options(3, 32);
+    opts.algorithm = PSORT_RADIXSORT;
+    psort_kv(kv, n, &opts);
+    test_equal_i(forall(k, n - 1, kv[k].key < kv[k + 1].key ||
+                 (kv[k].key == kv[k + 1].key && kv[k].value < kv[k + 1].value)), true);
+    free(kv);
+}
+
+// Fills a with one of several presorted patterns.
+void fill_presorted(int* a, int n, int pattern) {
+    for (int k = 0; k < n; k++) {
+        switch (pattern) {
+            case 0: a[k] = k; break; // sorted
+            case 1: a[k] = n - k; break; // reversed
+            case 2: a[k] = (n - k) / 3; break; // descending with duplicates
+            case 3: a[k] = k % (n / 7 + 1); break; // a few sorted runs
+            case 4: a[k] = k < n / 2 ? 2 * k : 2 * (n - k) + 1; break; // organ pipe
+            case 5: a[k] = k < n / 2 ? k : i_rnd(n); break; // sorted, then random
+            default: a[k] = k / 2; break; // nearly sorted
+        }
+    }
+    if (pattern == 6) {
+        for (int r = 0; r < n / 100 + 1; r++) {
+            int i = i_rnd(n), j = i_rnd(n);
+            int h = a[i]; a[i] = a[j]; a[j] = h;
+        }
+    } else if (pattern == 7) {
+        // groups of adjacent outliers
+        for (int r = 0; r < n / 300 + 1; r++) {
+            int i = i_rnd(n - 2);
+            for (int m = 0; m < 3; m++) a[i + m] = i_rnd(n);
+        }
+    }
+}
+
+void test_presorted(void) {
+    PSortAlgorithm algorithms[] = {PSORT_QUICKSORT, PSORT_MERGESORT, PSORT_SAMPLESORT, PSORT_RADIXSORT};
+    int ns[] = {100, 5000, 300000};
+    for (int i = 0; i < sizeof(ns) / sizeof(ns[0]); i++) {
+        int n = ns[i];
+        int* a = xmalloc(n * sizeof(int));
+        int* b = xmalloc(n * sizeof(int));
+        for (int pattern = 0; pattern < 8; pattern++) {
+            for (int g = 0; g < sizeof(algorithms) / sizeof(algorithms[0]); g++) {
+                fill_presorted(a, n, pattern);
+                memcpy(b, a, n * sizeof(int));
+                PSortOptions opts = options(4, 32);
+                opts.algorithm = algorithms[g];
+                psort_int(a, n, &opts);
+                qsort(b, n, sizeof(int), compare_int);
+                test_equal_i(memcmp(a, b, n * sizeof(int)), 0);
+            }
+        }
+        free(a);
+        free(b);
+    }
+
+    // a strictly descending run followed by ascending runs with the same keys:
+    // reversing the run keeps the merge sort stable
+    int n = 200000;
+    PSortKV* kv = xmalloc(n * sizeof(PSortKV));
+    for (int t = 1; t <= 4; t *= 4) {
+        for (int k = 0; k < n; k++) {
+            uint64_t key = k < n / 2 ? n / 2 - k : (k - n / 2) % 5000;
+            kv[k] = (PSortKV){key, (uint64_t)k};
+        }
+        PSortOptions opts = options(t, 32);
+        opts.algorithm = PSORT_MERGESORT;
+        psort_kv(kv, n, &opts);
+        test_equal_i(forall(k, n - 1, kv[k].key < kv[k + 1].key ||
+                     (kv[k].key == kv[k + 1].key && kv[k].value < kv[k + 1].value)), true);
+    }
+    free(kv);
+}
+
+void test_select(void) {
+    int ns[] = {1, 10, 1000, 300000};
+    for (int i = 0; i < sizeof(ns) / sizeof(ns[0]); i++) {
+        int n = ns[i];
+        int* a = xmalloc(n * sizeof(int));
+        int* b = xmalloc(n * sizeof(int));
+        int ks[] = {0, n / 2, n - 1, i_rnd(n)};
+        for (int j = 0; j < sizeof(ks) / sizeof(ks[0]); j++) {
+            int k = ks[j];
+            for (int x = 0; x < n; x++) a[x] = i_rnd(n / 2 + 1);
+            memcpy(b, a, n * sizeof(int));
+            qsort(b, n, sizeof(int), compare_int);
+            PSortOptions opts = options(4, 32);
+            psort_int_select(a, n, k, &opts);
+            test_equal_i(a[k], b[k]);
+            test_equal_i(forall(x, k, a[x] <= a[k]) && forall_x(int x = k + 1, x < n, x++, a[x] >= a[k]), true);
+        }
+        free(a);
+        free(b);
+    }
+}
+
+void test_partial_sort(void) {
+    int n = 200000;
+    int* a = xmalloc(n * sizeof(int));
+    int* b = xmalloc(n * sizeof(int));
+    int ks[] = {0, 1, 1000, n};
+    for (int j = 0; j < sizeof(ks) / sizeof(ks[0]); j++) {
+        int k = ks[j];
+        for (int x = 0; x < n; x++) a[x] = i_rnd(1 << 30);
+        memcpy(b, a, n * sizeof(int));
+        qsort(b, n, sizeof(int), compare_int);
+        psort_int_partial_sort(a, n, k, NULL);
+        test_equal_i(memcmp(a, b, k * sizeof(int)), 0);
+    }
+    free(a);
+    free(b);
+
+    // generic records, moved as a whole
+    int m = 20000;
+    Record* r = xmalloc(m * sizeof(Record));
+    for (int x = 0; x < m; x++) {
+        r[x].key = i_rnd(5000);
+        snprintf(r[x].name, sizeof(r[x].name), "%d", r[x].key);
+    }
+    PSortOptions opts = options(3, 32);
+    psort_partial_sort(r, m, sizeof(Record), 100, compare_record, &opts);
+    test_equal_i(forall(x, 99, r[x].key <= r[x + 1].key), true);
+    test_equal_i(forall_x(int x = 100, x < m, x++, r[x].key >= r[99].key), true);
+    test_equal_i(forall(x, m, atoi(r[x].name) == r[x].key), true);
+    psort_select(r, m, sizeof(Record), m / 2, compare_record, &opts);
+    test_equal_i(forall(x, m, x < m / 2 ? r[x].key <= r[m / 2].key : r[x].key >= r[m / 2].key), true);
+    free(r);
+}
+
+int compare_int_ptr(const void* x, const void* y) {
+    return compare_int(x, y);
+}
+
+int n_discarded = 0;
+
+void discard(void* x) {
+    n_discarded++;
+}
+
+typedef struct {
+    UChan* ch;
+    int* items;
+    int n;
+} TopKProducer;
+
+void* produce(void* arg) {
+    TopKProducer* p = arg;
+    for (int i = 0; i < p->n; i++) uchan_send(p->ch, &p->items[i]);
+    uchan_close(p->ch);
+    return NULL;
+}
+
+void test_top_k(void) {
+    int n = 100000, k = 50;
+    int* items = xmalloc(n * sizeof(int));
+    for (int i = 0; i < n; i++) items[i] = i_rnd(1 << 30);
+    TopKProducer p = {uchan_new(), items, n};
+    pthread_t thread;
+    int error = pthread_create(&thread, NULL, produce, &p);
+    panic_if(error != 0, "error %d", error);
+    void* top[50];
+    size_t n_top = psort_top_k(p.ch, top, k, compare_int_ptr, discard);
+    pthread_join(thread, NULL);
+    uchan_free(p.ch);
+    int* sorted = xmalloc(n * sizeof(int));
+    memcpy(sorted, items, n * sizeof(int));
+    qsort(sorted, n, sizeof(int), compare_int);
+    test_equal_i((int)n_top, k);
+    test_equal_i(forall(i, k, *(int*)top[i] == sorted[i]), true);
+    test_equal_i(n_discarded, n - k);
+
+    // fewer items than k
+    UChan* ch = uchan_new();
+    for (int i = 0; i < 3; i++) uchan_send(ch, &sorted[2 - i]);
+    uchan_close(ch);
+    n_top = psort_top_k(ch, top, k, compare_int_ptr, NULL);
+    test_equal_i((int)n_top, 3);
+    test_equal_i(top[0] == &sorted[0] && top[1] == &sorted[1] && top[2] == &sorted[2], true);
+    uchan_free(ch);
+    free(sorted);
+    free(items);
+}
+
+void test_batch(void) {
+    int n_arrays = 3000;
+    int** arrays = xmalloc(n_arrays * sizeof(int*));
+    int** expected = xmalloc(n_arrays * sizeof(int*));
+    size_t* lengths = xmalloc(n_arrays * sizeof(size_t));
+    for (int i = 0; i < n_arrays; i++) {
+        // a few large arrays that are sorted with all threads
+        lengths[i] = i % 1000 == 7 ? 200000 : (size_t)i_rnd(3000);
+        arrays[i] = xmalloc((lengths[i] + 1) * sizeof(int));
+        expected[i] = xmalloc((lengths[i] + 1) * sizeof(int));
+    }
+    int threads[] = {1, 4};
+    for (int t = 0; t < 2; t++) {
+        for (int i = 0; i < n_arrays; i++) {
+            for (size_t k = 0; k < lengths[i]; k++) arrays[i][k] = i_rnd(1000);
+            memcpy(expected[i], arrays[i], lengths[i] * sizeof(int));
+            qsort(expected[i], lengths[i], sizeof(int), compare_int);
+        }
+        PSortOptions opts = options(threads[t], 32);
+        psort_int_batch(arrays, lengths, n_arrays, &opts);
+        test_equal_i(forall(i, n_arrays, memcmp(arrays[i], expected[i], lengths[i] * sizeof(int)) == 0), true);
+    }
+    for (int i = 0; i < n_arrays; i++) {
+        free(arrays[i]);
+        free(expected[i]);
+    }
+    free(arrays);
+    free(expected);
+    free(lengths);
+
+    // no arrays
+    psort_kv_batch(NULL, NULL, 0, NULL);
+}
+
+// Checks that perm is the stable sorting permutation of the n ints at keys.
+bool is_stable_argsort(const int* keys, const size_t* perm, int n) {
+    bool* seen = xcalloc(n, sizeof(bool));
+    bool ok = true;
+    for (int i = 0; i < n && ok; i++) {
+        ok = perm[i] < (size_t)n && !seen[perm[i]];
+        if (ok) seen[perm[i]] = true;
+        if (ok && i > 0) {
+            int a = keys[perm[i - 1]], b = keys[perm[i]];
+            ok = a < b || (a == b && perm[i - 1] < perm[i]);
+        }
+    }
+    free(seen);
+    return ok;
+}
+
+void test_argsort(void) {
+    int ns[] = {0, 1, 100, 100000};
+    for (int i = 0; i < sizeof(ns) / sizeof(ns[0]); i++) {
+        int n = ns[i];
+        int* keys = xmalloc((n + 1) * sizeof(int));
+        size_t* perm = xmalloc((n + 1) * sizeof(size_t));
+        for (int k = 0; k < n; k++) keys[k] = i_rnd(n / 10 + 1) - n / 20 + (k % 7 == 0 ? INT_MIN : 0);
+        PSortOptions opts = options(4, 32);
+        psort_argsort_int(keys, n, perm, &opts);
+        test_equal_i(is_stable_argsort(keys, perm, n), true);
+
+        // the same with the comparison function and with 64-bit keys
+        psort_argsort(keys, n, sizeof(int), compare_int, perm, &opts);
+        test_equal_i(is_stable_argsort(keys, perm, n), true);
+        uint64_t* keys64 = xmalloc((n + 1) * sizeof(uint64_t));
+        for (int k = 0; k < n; k++) keys64[k] = (uint64_t)((int64_t)keys[k] + (1LL << 31));
+        psort_argsort_uint64(keys64, n, perm, &opts);
+        test_equal_i(is_stable_argsort(keys, perm, n), true);
+        free(keys64);
+        free(keys);
+        free(perm);
+    }
+
+    int n = 50000;
+    float* f = xmalloc(n * sizeof(float));
+    size_t* perm = xmalloc(n * sizeof(size_t));
+    for (int k = 0; k < n; k++) f[k] = k % 100 == 0 ? NAN : k % 100 == 1 ? -0.0f : (float)i_rnd(1000) - 500.25f;
+    psort_argsort_float(f, n, perm, NULL);
+    test_equal_i(forall(k, n - n / 100 - 1, f[perm[k]] < f[perm[k + 1]] ||
+                 (f[perm[k]] == f[perm[k + 1]] && perm[k] < perm[k + 1])), true);
+    test_equal_i(forall_x(int k = n - n / 100, k < n, k++, isnan(f[perm[k]])), true);
+    free(f);
+    free(perm);
+}
+
+// Sorts a struct of arrays by one column and moves the other columns along.
+void test_permute_columns(void) {
+    int n = 300000;
+    int* keys = xmalloc(n * sizeof(int));
+    double* values = xmalloc(n * sizeof(double));
+    Record* records = xmalloc(n * sizeof(Record));
+    for (int k = 0; k < n; k++) {
+        keys[k] = i_rnd(1000);
+        values[k] = keys[k] * 0.5;
+        records[k].key = keys[k];
+        snprintf(records[k].name, sizeof(records[k].name), "%d", k);
+    }
+    size_t* perm = xmalloc(n * sizeof(size_t));
+    PSortOptions opts = options(4, 32);
+    psort_argsort_int(keys, n, perm, &opts);
+    void* columns[] = {keys, values, records};
+    size_t sizes[] = {sizeof(int), sizeof(double), sizeof(Record)};
+    psort_permute_columns(columns, sizes, 3, perm, n, &opts);
+    test_equal_i(forall(k, n - 1, keys[k] <= keys[k + 1]), true);
+    test_equal_i(forall(k, n, values[k] == keys[k] * 0.5 && records[k].key == keys[k]), true);
+    test_equal_i(forall(k, n, atoi(records[k].name) == (int)perm[k]), true);
+
+    // out of place
+    Record* gathered = xmalloc(n * sizeof(Record));
+    for (int k = 0; k < n; k++) perm[k] = n - 1 - k;
+    psort_gather(gathered, records, sizeof(Record), perm, n, &opts);
+    test_equal_i(forall(k, n, gathered[k].key == records[n - 1 - k].key), true);
+    free(gathered);
+    free(perm);
+    free(records);
+    free(values);
+    free(keys);
+}
+
+// Fills arrays in parallel and checks sortedness and the checksum across the
+// block boundaries of the threads.
+void test_fill_and_check(void) {
+    int n = 300000;
+    int* a = xmalloc(n * sizeof(int));
+    int* b = xmalloc(n * sizeof(int));
+    psort_fill_random_int(a, n, 1000, 42, 1);
+    psort_fill_random_int(b, n, 1000, 42, 4);
+    test_equal_i(memcmp(a, b, n * sizeof(int)), 0);
+    test_equal_i(forall(i, n, 0 <= a[i] && a[i] < 1000), true);
+    psort_fill_random_int(b, n, 1000, 43, 4);
+    test_equal_i(memcmp(a, b, n * sizeof(int)) != 0, true);
+
+    uint64_t before, after;
+    test_equal_i(psort_check_int(a, n, 4, &before), false);
+    PSortOptions opts = options(4, 32);
+    psort_int(a, n, &opts);
+    test_equal_i(psort_check_int(a, n, 4, &after), true);
+    test_equal_i(before == after, true);
+    test_equal_i(psort_check_int(a, n, 1, NULL), true);
+
+    // a descent exactly at the boundary between the blocks of two threads
+    int* c = xmalloc(n * sizeof(int));
+    for (int i = 0; i < n; i++) c[i] = i < n / 2 ? i : i - n / 2;
+    test_equal_i(psort_check_int(c, n, 2, NULL), false);
+    test_equal_i(psort_check_int(c, n / 2, 2, NULL), true);
+    test_equal_i(psort_check_int(c, 0, 2, NULL), true);
+
+    // changing an element changes the checksum
+    a[n - 1]++;
+    test_equal_i(psort_check_int(a, n, 4, &after), true);
+    test_equal_i(before != after, true);
+    free(c);
+    free(b);
+    free(a);
+}
+
+typedef struct {
+    PSortBlocks b;
+    long int sums[PSORT_THREADS_MAX];
+} BlockSums;
+
+void* sum_block(void* arg) {
+    PSortBlockArg* ba = arg;
+    BlockSums* bs = ba->shared;
+    PSortRange r = bs->b.blocks[ba->t];
+    for (long int i = r.begin; i < r.end; i++) bs->sums[ba->t] += i;
+    return NULL;
+}
+
+// Runs blocks on a pool, and large intervals of the quicksort through the
+// parallel partition on the pool threads.
+void test_pool(void) {
+    PSortPool* pool = psort_pool_new(3);
+    test_equal_i(psort_pool_size(pool), 3);
+    for (int n_blocks = 1; n_blocks <= 4; n_blocks++) {
+        BlockSums bs = {0};
+        psort_split_blocks(&bs.b, 0, 1000, n_blocks);
+        psort_run_on_pool(n_blocks % 2 == 0 ? pool : NULL, &bs, n_blocks, sum_block);
+        long int sum = 0;
+        for (int t = 0; t < n_blocks; t++) sum += bs.sums[t];
+        test_equal_i(sum, 999 * 1000 / 2);
+    }
+    psort_pool_free(pool);
+    psort_pool_free(NULL);
+
+    int n = 300000;
+    int* a = xmalloc(n * sizeof(int));
+    int* b = xmalloc(n * sizeof(int));
+    int thread_counts[] = {2, 3, 8};
+    for (int i = 0; i < 3; i++) {
+        for (int fat = 0; fat < 2; fat++) {
+            for (int k = 0; k < n; k++) a[k] = i_rnd(fat ? 100 : n);
+            memcpy(b, a, n * sizeof(int));
+            PSortOptions opts = options(thread_counts[i], 32);
+            opts.algorithm = PSORT_QUICKSORT;
+            opts.fat_pivot = fat;
+            psort_int(a, n, &opts);
+            qsort(b, n, sizeof(int), compare_int);
+            test_equal_i(memcmp(a, b, n * sizeof(int)), 0);
+        }
+    }
+    free(b);
+    free(a);
+}
+
+int main(void) {
+    test_int();
+    test_float();
+    test_uint64();
+    test_kv();
+    test_generic();
+    test_stable();
+    test_mergesort_generic();
+    test_samplesort();
+    test_radixsort();
+    test_presorted();
+    test_select();
+    test_partial_sort();
+    test_top_k();
+    test_batch();
+    test_argsort();
+    test_permute_columns();
+    test_fill_and_check();
+    test_pool();
+    return 0;
+}
@@ -1,18 +1,44 @@
 /*
-This is a multithreaded non-recursive version of Quicksort that uses unbounded
-FIFO channels for communication. One step of the algorithm involves taking an
-interval out of the work channel, partitioning the corresponding slice of the
-array to be sorted, and putting the resulting subintervals into the channel.
-Partitioning the interval means randomly picking an element of the slice as a
-pivot element p and rearranging the values such that the items left of the pivot
-element are less than or equal to p and the items to the right of the pivot
-element are greater than p.
-
-The algorithm works in-place in the input array. This means that the speedup
-from multiple threads is not large, likely because of caching issues. To
-generate a second kind of load, which only uses the local stack of each thread,
-Fibonacci sequences are computed. The Fibonacci computation can be switched off
-by commenting out the ENABLE_FIB symbol.
+Demo and benchmarks for the multithreaded Quicksort of psort.c, which uses
+unbounded FIFO channels for communication: Workers take intervals out of the
+work channel, partition the corresponding slice of the array, and put the
+resulting subintervals back into the channel. Intervals with fewer than
+grain_size elements are sorted sequentially by the worker that produced them.
+The best grain size depends on the machine. It can be determined with the sweep
+benchmark:
+
+    make clean && make DEBUG="-O2 -DNO_ASSERT -DNO_REQUIRE -DNO_ENSURE"
+    ./quicksort sweep 10000000
+
+Without arguments the program sorts ARR_LENGTH elements with N_THREADS threads
+and a grain size of PSORT_GRAIN_SIZE. Otherwise the arguments are: quicksort [n
+[threads [grain_size [partition_scheme]]]]. The partitioning schemes of
+partition.c (hoare, branchless, simd) can be compared with: quicksort compare [n
+[threads]].
+
+Arrays with few distinct values would degenerate towards quadratic time without
+fat pivots, as all keys equal to the pivot end up in the lower part. The effect
+on low-cardinality inputs is shown by: quicksort distinct [n [threads]].
+
+The sort algorithms of psort (quicksort, mergesort, samplesort, radixsort) can be
+compared with: quicksort algorithms [n [threads]]. The sample sort is meant for
+large arrays on many cores, e.g. n = 10^7 to 10^9 (the latter needs about 13
+GB).
+
+Sorted, reversed, and nearly sorted inputs are detected by psort. The time with
+and without the detection is compared by: quicksort presorted [n [threads]].
+
+Finding the median or the k smallest elements does not need a full sort. The
+selection of psort is compared with sorting by: quicksort select [n [threads
+[k]]].
+
+Many small arrays are sorted faster as a batch than one by one: quicksort batch
+[n_arrays [threads]].
+
+The input arrays are filled and verified in parallel (psort_fill_random_int,
+psort_check_int), so that setting up and checking large arrays does not take
+longer than sorting them. The check compares an order-independent checksum
+before and after sorting.
 
 @author: Michael Rohs
 @date: January 5, 2023
@@ -24,16 +50,12 @@ by commenting out the ENABLE_FIB symbol.
 #define NO_ENSURE
 #endif
 
-#define ENABLE_FIB
 #define ARR_LENGTH 1000
 #define N_THREADS 8
 
 #include <pthread.h>
-#include <stdatomic.h>
-#include <unistd.h>
 #include "util.h"
-#include "uchan.h"
-#include "countdown.h"
+#include "psort.h"
 
 // Prints the stack size of the calling thread.
 size_t get_stacksize(void) {
@@ -48,182 +70,388 @@ size_t get_stacksize(void) {
     return stacksize;
 }
 
-// Partitions the slice of array a denoted by index interval [low, high] (bounds
-// inclusive) using pivot element p that is randomply picked from a, such that the
-// resulting slice has the form {...<=p..., p, ...>p...}.
-// Returns the index of the pivot element.
-int partition(int* a, int low, int high) {
-    require_not_null(a);
-    require("valid bounds", 0 <= low && low <= high);
-    if (low == high) return low;
-    assert("", low < high);
-    int pi = low + i_rnd(high - low + 1);
-    int p = a[pi];
-    a[pi] = a[low];
-    a[low] = p;
-    int i = low + 1, j = high;
-    assert("", i <= j);
-    while (i <= j) {
-        assert("lower part <= p", forall_x(int k = low, k < i, k++, a[k] <= p));
-        assert("upper part > p", forall_x(int k = j + 1, k <= high, k++, a[k] > p));
-        while (i <= j && a[i] <= p) i++;
-        assert("", i > j || a[i] > p); 
-        if (i > j) break;
-        assert("", a[i] > p); 
-        while (i <= j && a[j] > p) j--;
-        assert("", a[i] > p && (i > j || a[j] <= p));
-        if (i > j) break;
-        assert("", i < j && a[i] > p && a[j] <= p);
-        int h = a[i];
-        a[i] = a[j];
-        a[j] = h;
-        assert("", i < j && a[i] <= p && a[j] > p);
-        i++; j--;
-    }
-    assert("", i == j + 1);
-    assert("lower part <= p", forall_x(int k = low, k <= j, k++, a[k] <= p));
-    assert("upper part > p", forall_x(int k = j + 1, k <= high, k++, a[k] > p));
-    int h = a[j];
-    a[j] = p;
-    a[low] = h;
-    ensure("lower part <= p", forall_x(int k = low, k <= j, k++, a[k] <= p));
-    ensure("upper part > p", forall_x(int k = j + 1, k <= high, k++, a[k] > p));
-    return j;
-}
-
-// Represents an interval with inclusive boundaries.
-typedef struct {
-    int low, high;
-} Interval;
-
-_Static_assert(sizeof(void*) == sizeof(Interval), "valid size");
-
-// Sends an interval to the channel.
-void uchan_send_interval(UChan* ch, int low, int high) {
-    long int i = ((long int)high << 32) | ((long int)low & 0xffffffffL);
-    uchan_send(ch, (void*)i);
-}
-
-// Receives an interval from the channel. If necessary, blocks until an interval
-// is available. Returns false if the channel has been closed and no more intervals
-// are available.
-bool uchan_receive_interval(UChan* ch, Interval* i) {
-    return uchan_receive2(ch, (void*)i);
-}
-
-// Recursively computes the n-th Fibonacci number.
-int fib(int n) {
-    if (n <= 0) return 0;
-    if (n == 1) return 1;
-    return fib(n - 1) + fib(n - 2);
-}
-
-// Represents the set of arguments given to the thread function.
-typedef struct Args Args;
-struct Args {
-    int* arr;
-    UChan* ch_work; // work channel, contains intervals
-    UChan* ch_results; // dummy results channel
-    Countdown* c;
-};
-
-// The worker thread function repeatedly picks an interval from the channel,
-// partitions the corresponding array slice, and (if the slices left or right of
-// the pivot element have at least length two) writes new intervals to the channel.
-// The worker thread finishes when the channel has been closed and no more
-// intervals are available.
-void* thread_func(void* arg) {
-    // stderr_log("stacksize = %lu", get_stacksize());
-    require_not_null(arg);
-    Args* a = arg;
-    // counter for the number of elements that this thread partitioned,
-    // represents the amount of work that this thread performed
-    int partitioned_elements = 0;
-    // number of elements that this thread sorted to its final position
-    int sorted_elements = 0;
-    Interval i;
-    while (uchan_receive_interval(a->ch_work, &i)) {
-        //stderr_log("low = %d, high = %d", i.low, i.high);
-        assert("bounds not negative and interval has at least two elements", 0 <= i.low && i.low < i.high);
-
-#ifdef ENABLE_FIB
-        // do some more artificial work on the thread's stack
-        for (int i = 0; i < 200; i++) {
-            int x = fib(20); // work channel, contains intervals
-            uchan_send_int(a->ch_results, x); // dummy results channel
+// Sorts arr with psort_int as configured by opts. Returns the time taken in
+// milliseconds.
+double quicksort(int* arr, long int n_arr, const PSortOptions* opts) {
+    require_not_null(arr);
+    require_not_null(opts);
+    require("positive", n_arr > 0 && opts->n_threads > 0);
+    timespec start = time_now();
+    psort_int(arr, n_arr, opts);
+    return time_ms_since(start);
+}
+
+// Fills the array with random numbers in parallel. Each call produces new
+// numbers.
+void fill_random(int* arr, long int n_arr, int n_threads) {
+    require_not_null(arr);
+    static uint64_t seed = 1;
+    psort_fill_random_int(arr, n_arr, (uint32_t)(10L * n_arr < UINT32_MAX ? 10L * n_arr : 0), seed++, n_threads);
+}
+
+// Fills the array with random numbers out of k distinct values.
+void fill_random_distinct(int* arr, long int n_arr, int k) {
+    require_not_null(arr);
+    require("positive", k > 0);
+    for (long int i = 0; i < n_arr; i++) {
+        arr[i] = 1000 * i_rnd(k);
+    }
+}
+
+// Returns the default options for the given number of threads.
+PSortOptions default_options(int n_threads) {
+    PSortOptions opts = psort_options();
+    opts.n_threads = n_threads;
+    opts.algorithm = PSORT_QUICKSORT;
+    return opts;
+}
+
+// Checks in parallel whether the array is sorted.
+bool is_sorted(int* arr, long int n_arr, int n_threads) {
+    require_not_null(arr);
+    return psort_check_int(arr, n_arr, n_threads, NULL);
+}
+
+// Returns the order-independent checksum of the array.
+uint64_t checksum(int* arr, long int n_arr, int n_threads) {
+    require_not_null(arr);
+    uint64_t sum;
+    psort_check_int(arr, n_arr, n_threads, &sum);
+    return sum;
+}
+
+// Measures the sort time for a range of grain sizes to determine the best
+// sequential cutoff. Each configuration is measured several times on fresh
+// random data and the fastest run is reported.
+void sweep_grain_size(long int n_arr, int n_threads) {
+    require("positive", n_arr > 0 && n_threads > 0);
+    int n_runs = 5;
+    int* arr = xmalloc(n_arr * sizeof(int));
+    printf("n = %ld, threads = %d\n", n_arr, n_threads);
+    printf("%10s %12s\n", "grain_size", "best ms");
+    for (int grain_size = 2; grain_size <= 65536; grain_size *= 2) {
+        PSortOptions opts = default_options(n_threads);
+        opts.grain_size = grain_size;
+        double best = 0;
+        for (int r = 0; r < n_runs; r++) {
+            fill_random(arr, n_arr, n_threads);
+            double ms = quicksort(arr, n_arr, &opts);
+            panic_if(!is_sorted(arr, n_arr, n_threads), "not sorted (grain_size = %d)", grain_size);
+            if (r == 0 || ms < best) best = ms;
         }
-        // pthread_yield_np();
-#endif
+        printf("%10d %12.1f\n", grain_size, best);
+    }
+    free(arr);
+}
 
-        int p = partition(a->arr, i.low, i.high);
-        partitioned_elements += i.high - i.low + 1;
-        sorted_elements++;
-        countdown_dec(a->c);
-        int n_left = (p - 1) - i.low + 1;
-        if (n_left > 1) {
-            uchan_send_interval(a->ch_work, i.low, p - 1);
-        } else if (n_left == 1) {
-            sorted_elements++;
-            countdown_dec(a->c);
+// Sorts the same random data with each partitioning scheme and reports the
+// fastest of several runs.
+void compare_schemes(long int n_arr, int n_threads) {
+    require("positive", n_arr > 0 && n_threads > 0);
+    int n_runs = 5;
+    char* names[] = {"hoare", "branchless", "simd"};
+    int* data = xmalloc(n_arr * sizeof(int));
+    int* arr = xmalloc(n_arr * sizeof(int));
+    printf("n = %ld, threads = %d, simd = %s\n", n_arr, n_threads, partition_simd_isa());
+    printf("%10s %12s\n", "scheme", "best ms");
+    for (int i = 0; i < 3; i++) {
+        PSortOptions opts = default_options(n_threads);
+        opts.scheme = partition_scheme(names[i]);
+        double best = 0;
+        for (int r = 0; r < n_runs; r++) {
+            if (i == 0) fill_random(data, n_arr, n_threads);
+            psort_parallel_copy(arr, data, n_arr * sizeof(int), n_threads);
+            double ms = quicksort(arr, n_arr, &opts);
+            panic_if(!is_sorted(arr, n_arr, n_threads), "not sorted (scheme = %s)", names[i]);
+            if (r == 0 || ms < best) best = ms;
         }
-        int n_right = i.high - (p + 1) + 1;
-        if (n_right > 1) {
-            uchan_send_interval(a->ch_work, p + 1, i.high);
-        } else if (n_right == 1) {
-            sorted_elements++;
-            countdown_dec(a->c);
+        printf("%10s %12.1f\n", names[i], best);
+    }
+    free(arr);
+    free(data);
+}
+
+// Sorts arrays with few distinct values, with and without fat pivots, and
+// reports the fastest of several runs. Without fat pivots, keys equal to the
+// pivot all go to the lower part, so the intervals shrink by only one element
+// per step when most keys are equal.
+void compare_distinct(long int n_arr, int n_threads) {
+    require("positive", n_arr > 0 && n_threads > 0);
+    int n_runs = 3;
+    int ks[] = {1, 2, 4, 16, 256, 65536};
+    int* arr = xmalloc(n_arr * sizeof(int));
+    printf("n = %ld, threads = %d\n", n_arr, n_threads);
+    printf("%10s %12s %12s\n", "distinct", "2-way ms", "fat ms");
+    for (size_t i = 0; i < sizeof(ks) / sizeof(ks[0]); i++) {
+        double best[2] = {0, 0};
+        for (int fat = 0; fat <= 1; fat++) {
+            PSortOptions opts = default_options(n_threads);
+            opts.fat_pivot = fat;
+            opts.adaptive = false;
+            for (int r = 0; r < n_runs; r++) {
+                fill_random_distinct(arr, n_arr, ks[i]);
+                double ms = quicksort(arr, n_arr, &opts);
+                panic_if(!is_sorted(arr, n_arr, n_threads), "not sorted (distinct = %d)", ks[i]);
+                if (r == 0 || ms < best[fat]) best[fat] = ms;
+            }
         }
+        printf("%10d %12.1f %12.1f\n", ks[i], best[0], best[1]);
     }
-    stderr_log("partitioned_elements = %d, sorted_elements = %d",
-                partitioned_elements, sorted_elements);
-    assert("countdown finished", countdown_finished(a->c));
-    return NULL;
+    free(arr);
 }
 
-int main(void) {
-    stderr_log("stacksize = %lu", get_stacksize());
+// Sorts the same random data with each algorithm of psort and reports the fastest
+// of several runs.
+void compare_algorithms(long int n_arr, int n_threads) {
+    require("positive", n_arr > 0 && n_threads > 0);
+    int n_runs = 3;
+    char* names[] = {"quicksort", "mergesort", "samplesort", "radixsort"};
+    PSortAlgorithm algorithms[] = {PSORT_QUICKSORT, PSORT_MERGESORT, PSORT_SAMPLESORT, PSORT_RADIXSORT};
+    int n_algorithms = sizeof(algorithms) / sizeof(algorithms[0]);
+    int* data = xmalloc(n_arr * sizeof(int));
+    int* arr = xmalloc(n_arr * sizeof(int));
+    fill_random(data, n_arr, n_threads);
+    uint64_t sum = checksum(data, n_arr, n_threads);
+    printf("n = %ld, threads = %d\n", n_arr, n_threads);
+    printf("%10s %12s\n", "algorithm", "best ms");
+    for (int i = 0; i < n_algorithms; i++) {
+        PSortOptions opts = default_options(n_threads);
+        opts.algorithm = algorithms[i];
+        double best = 0;
+        for (int r = 0; r < n_runs; r++) {
+            psort_parallel_copy(arr, data, n_arr * sizeof(int), n_threads);
+            double ms = quicksort(arr, n_arr, &opts);
+            panic_if(!is_sorted(arr, n_arr, n_threads), "not sorted (algorithm = %s)", names[i]);
+            panic_if(checksum(arr, n_arr, n_threads) != sum, "elements changed (algorithm = %s)", names[i]);
+            if (r == 0 || ms < best) best = ms;
+        }
+        printf("%10s %12.1f\n", names[i], best);
+    }
+    free(arr);
+    free(data);
+}
 
-    int n_arr = ARR_LENGTH;
-    UChan* ch_work = uchan_new(); // work channel, contains intervals
-    UChan* ch_results = uchan_new(); // dummy results channel
-    Countdown* countdown = countdown_new(n_arr); // to determine when we are done
-    int error;
+// Fills arr with an input of the given shape: sorted, reversed, few runs (the
+// concatenation of eight sorted parts), nearly sorted (1% of the elements
+// swapped), or random.
+void fill_shape(int* arr, long int n_arr, const char* shape, int n_threads) {
+    if (strcmp(shape, "random") == 0) {
+        fill_random(arr, n_arr, n_threads);
+        return;
+    }
+    for (long int i = 0; i < n_arr; i++) {
+        if (strcmp(shape, "reversed") == 0) arr[i] = (int)(n_arr - i);
+        else if (strcmp(shape, "runs") == 0) arr[i] = (int)(i % (n_arr / 8 + 1));
+        else arr[i] = (int)i;
+    }
+    if (strcmp(shape, "nearly") == 0) {
+        uint64_t state = (uint64_t)n_arr;
+        for (long int r = 0; r < n_arr / 100; r++) {
+            long int i = (long int)(psort_random(&state) % (uint64_t)n_arr);
+            long int j = (long int)(psort_random(&state) % (uint64_t)n_arr);
+            int h = arr[i]; arr[i] = arr[j]; arr[j] = h;
+        }
+    }
+}
 
-    // fill the array with random numbers
+// Measures the sort of presorted inputs with and without run detection.
+void compare_presorted(long int n_arr, int n_threads) {
+    require("positive", n_arr > 0 && n_threads > 0);
+    int n_runs = 3;
+    char* shapes[] = {"sorted", "reversed", "runs", "nearly", "random"};
+    int n_shapes = sizeof(shapes) / sizeof(shapes[0]);
+    int* data = xmalloc(n_arr * sizeof(int));
     int* arr = xmalloc(n_arr * sizeof(int));
-    for (int i = 0; i < n_arr; i++) {
-        arr[i] = i_rnd(10 * n_arr);
+    printf("n = %ld, threads = %d\n", n_arr, n_threads);
+    printf("%10s %12s %12s\n", "input", "adaptive ms", "plain ms");
+    for (int i = 0; i < n_shapes; i++) {
+        fill_shape(data, n_arr, shapes[i], n_threads);
+        printf("%10s", shapes[i]);
+        for (int adaptive = 1; adaptive >= 0; adaptive--) {
+            PSortOptions opts = default_options(n_threads);
+            opts.adaptive = adaptive;
+            double best = 0;
+            for (int r = 0; r < n_runs; r++) {
+                psort_parallel_copy(arr, data, n_arr * sizeof(int), n_threads);
+                double ms = quicksort(arr, n_arr, &opts);
+                panic_if(!is_sorted(arr, n_arr, n_threads), "not sorted (input = %s)", shapes[i]);
+                if (r == 0 || ms < best) best = ms;
+            }
+            printf(" %12.1f", best);
+        }
+        printf("\n");
     }
+    free(arr);
+    free(data);
+}
 
-    timespec start = time_now();
+// Compares sorting the whole array with selecting the median and with sorting
+// only the k smallest elements.
+void compare_selection(long int n_arr, int n_threads, long int k) {
+    require("positive", n_arr > 0 && n_threads > 0);
+    require("valid count", 0 < k && k <= n_arr);
+    int n_runs = 3;
+    char* names[] = {"sort", "median", "partial"};
+    int* data = xmalloc(n_arr * sizeof(int));
+    int* arr = xmalloc(n_arr * sizeof(int));
+    fill_random(data, n_arr, n_threads);
+    PSortOptions opts = default_options(n_threads);
+    printf("n = %ld, threads = %d, k = %ld\n", n_arr, n_threads, k);
+    printf("%10s %12s\n", "operation", "best ms");
+    for (int i = 0; i < 3; i++) {
+        double best = 0;
+        for (int r = 0; r < n_runs; r++) {
+            psort_parallel_copy(arr, data, n_arr * sizeof(int), n_threads);
+            timespec start = time_now();
+            if (i == 0) psort_int(arr, n_arr, &opts);
+            else if (i == 1) psort_int_select(arr, n_arr, n_arr / 2, &opts);
+            else psort_int_partial_sort(arr, n_arr, k, &opts);
+            double ms = time_ms_since(start);
+            if (r == 0 || ms < best) best = ms;
+        }
+        panic_if(i == 2 && !is_sorted(arr, k, n_threads), "not sorted");
+        printf("%10s %12.1f\n", names[i], best);
+    }
+    free(arr);
+    free(data);
+}
+
+// Compares the batch sort of many small arrays with sorting each array on its
+// own, once with all threads and once with a single thread.
+void compare_batch(int n_arrays, int n_threads) {
+    require("positive", n_arrays > 0 && n_threads > 0);
+    int n_runs = 3;
+    char* names[] = {"batch", "each", "sequential"};
+    size_t* lengths = xmalloc(n_arrays * sizeof(size_t));
+    int** data = xmalloc(n_arrays * sizeof(int*));
+    int** arrays = xmalloc(n_arrays * sizeof(int*));
+    long int total = 0;
+    for (int i = 0; i < n_arrays; i++) {
+        lengths[i] = 10 + i_rnd(10000);
+        total += lengths[i];
+        data[i] = xmalloc(lengths[i] * sizeof(int));
+        arrays[i] = xmalloc(lengths[i] * sizeof(int));
+        fill_random(data[i], lengths[i], 1);
+    }
+    printf("arrays = %d, elements = %ld, threads = %d\n", n_arrays, total, n_threads);
+    printf("%10s %12s\n", "method", "best ms");
+    for (int m = 0; m < 3; m++) {
+        PSortOptions opts = default_options(m == 2 ? 1 : n_threads);
+        double best = 0;
+        for (int r = 0; r < n_runs; r++) {
+            for (int i = 0; i < n_arrays; i++) memcpy(arrays[i], data[i], lengths[i] * sizeof(int));
+            timespec start = time_now();
+            if (m == 0) {
+                psort_int_batch(arrays, lengths, n_arrays, &opts);
+            } else {
+                for (int i = 0; i < n_arrays; i++) psort_int(arrays[i], lengths[i], &opts);
+            }
+            double ms = time_ms_since(start);
+            if (r == 0 || ms < best) best = ms;
+        }
+        for (int i = 0; i < n_arrays; i++) panic_if(!is_sorted(arrays[i], lengths[i], 1), "not sorted");
+        printf("%10s %12.1f\n", names[m], best);
+    }
+    for (int i = 0; i < n_arrays; i++) {
+        free(data[i]);
+        free(arrays[i]);
+    }
+    free(arrays);
+    free(data);
+    free(lengths);
+}
+
+int main(int argc, char* argv[]) {
+    stderr_log("stacksize = %lu", get_stacksize());
+    stderr_log("partition kernel = %s", partition_simd_isa());
 
-    // start the threads
-    int n_threads = N_THREADS;
-    pthread_t threads[n_threads];
-    for (int i = 0; i < n_threads; i++) {
-        error = pthread_create(&threads[i], NULL, thread_func,
-                               &(Args){arr, ch_work, ch_results, countdown});
-        panic_if(error != 0, "error %d", error);
+    if (argc >= 2 && strcmp(argv[1], "sweep") == 0) {
+        long int n_arr = argc >= 3 ? atol(argv[2]) : 1000000;
+        int n_threads = argc >= 4 ? atoi(argv[3]) : N_THREADS;
+        exit_if(n_arr <= 0 || n_threads <= 0 || n_threads > PSORT_THREADS_MAX,
+                "usage: quicksort sweep [n [threads]]");
+        sweep_grain_size(n_arr, n_threads);
+        return 0;
     }
 
-    // the initial interval is the whole array
-    uchan_send_interval(ch_work, 0, n_arr - 1);
+    if (argc >= 2 && strcmp(argv[1], "compare") == 0) {
+        long int n_arr = argc >= 3 ? atol(argv[2]) : 1000000;
+        int n_threads = argc >= 4 ? atoi(argv[3]) : N_THREADS;
+        exit_if(n_arr <= 0 || n_threads <= 0 || n_threads > PSORT_THREADS_MAX,
+                "usage: quicksort compare [n [threads]]");
+        compare_schemes(n_arr, n_threads);
+        return 0;
+    }
 
-    // wait for countdown to reach zero
-    countdown_wait(countdown);
+    if (argc >= 2 && strcmp(argv[1], "distinct") == 0) {
+        long int n_arr = argc >= 3 ? atol(argv[2]) : 100000;
+        int n_threads = argc >= 4 ? atoi(argv[3]) : N_THREADS;
+        exit_if(n_arr <= 0 || n_threads <= 0 || n_threads > PSORT_THREADS_MAX,
+                "usage: quicksort distinct [n [threads]]");
+        compare_distinct(n_arr, n_threads);
+        return 0;
+    }
 
-    // close the channel and wait for the threads to finish
-    uchan_close(ch_work);
-    for (int i = 0; i < n_threads; i++) {
-        error = pthread_join(threads[i], NULL);
-        panic_if(error != 0, "error %d", error);
+    if (argc >= 2 && strcmp(argv[1], "algorithms") == 0) {
+        long int n_arr = argc >= 3 ? atol(argv[2]) : 10000000;
+        int n_threads = argc >= 4 ? atoi(argv[3]) : N_THREADS;
+        exit_if(n_arr <= 0 || n_threads <= 0 || n_threads > PSORT_THREADS_MAX,
+                "usage: quicksort algorithms [n [threads]]");
+        compare_algorithms(n_arr, n_threads);
+        return 0;
     }
-    countdown_free(countdown);
-    uchan_free(ch_work);
-    uchan_free(ch_results);
 
-    printf("time = %.1f ms\n", time_ms_since(start));
-    ensure("sorted", forall(i, n_arr - 1, arr[i] <= arr[i+1]));
+    if (argc >= 2 && strcmp(argv[1], "presorted") == 0) {
+        long int n_arr = argc >= 3 ? atol(argv[2]) : 10000000;
+        int n_threads = argc >= 4 ? atoi(argv[3]) : N_THREADS;
+        exit_if(n_arr <= 0 || n_threads <= 0 || n_threads > PSORT_THREADS_MAX,
+                "usage: quicksort presorted [n [threads]]");
+        compare_presorted(n_arr, n_threads);
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "select") == 0) {
+        long int n_arr = argc >= 3 ? atol(argv[2]) : 10000000;
+        int n_threads = argc >= 4 ? atoi(argv[3]) : N_THREADS;
+        long int k = argc >= 5 ? atol(argv[4]) : 1000;
+        exit_if(n_arr <= 0 || n_threads <= 0 || n_threads > PSORT_THREADS_MAX || k <= 0 || k > n_arr,
+                "usage: quicksort select [n [threads [k]]]");
+        compare_selection(n_arr, n_threads, k);
+        return 0;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "batch") == 0) {
+        int n_arrays = argc >= 3 ? atoi(argv[2]) : 10000;
+        int n_threads = argc >= 4 ? atoi(argv[3]) : N_THREADS;
+        exit_if(n_arrays <= 0 || n_threads <= 0 || n_threads > PSORT_THREADS_MAX,
+                "usage: quicksort batch [n_arrays [threads]]");
+        compare_batch(n_arrays, n_threads);
+        return 0;
+    }
+
+    long int n_arr = argc >= 2 ? atol(argv[1]) : ARR_LENGTH;
+    PSortOptions opts = default_options(argc >= 3 ? atoi(argv[2]) : N_THREADS);
+    opts.scheme = partition_scheme(argc >= 5 ? argv[4] : "simd");
+    if (argc >= 4) opts.grain_size = atol(argv[3]);
+    exit_if(n_arr <= 0 || opts.n_threads <= 0 || opts.n_threads > PSORT_THREADS_MAX || opts.scheme == NULL,
+            "usage: quicksort [n [threads [grain_size [hoare|branchless|simd]]]]");
+
+    // fill the array with random numbers
+    int* arr = xmalloc(n_arr * sizeof(int));
+    timespec start = time_now();
+    fill_random(arr, n_arr, opts.n_threads);
+    uint64_t sum = checksum(arr, n_arr, opts.n_threads);
+    double fill_ms = time_ms_since(start);
+
+    double ms = quicksort(arr, n_arr, &opts);
+
+    start = time_now();
+    uint64_t sorted_sum;
+    bool sorted = psort_check_int(arr, n_arr, opts.n_threads, &sorted_sum);
+    double check_ms = time_ms_since(start);
+    printf("time = %.1f ms (fill %.1f ms, check %.1f ms)\n", ms, fill_ms, check_ms);
+    panic_if(!sorted, "not sorted");
+    panic_if(sorted_sum != sum, "elements changed");
     free(arr);
 
     return 0;
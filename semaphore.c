@@ -0,0 +1,221 @@
+/*
+Semaphore is a counting semaphore for limiting concurrent access to scarce
+resources. It replaces the pattern of pre-filling a UChan with tokens, which
+costs a queue slot per permit and a mutex round-trip per acquire and release.
+
+The permit counter is an atomic integer. As long as no thread is waiting,
+acquiring and releasing permits are single compare-and-swap or fetch-and-add
+operations that do not touch the mutex. Threads that cannot get their permits
+immediately enter a FIFO wait queue. Each waiter has its own condition variable,
+so it is woken individually when its request can be granted. Waiters are served
+strictly in arrival order: a waiter that needs many permits blocks the waiters
+behind it, even if their smaller requests could be satisfied. This avoids
+starvation of bulk requests. While the wait queue is not empty, the fast path is
+disabled, so new arrivals queue up behind existing waiters.
+
+@author: Michael Rohs
+@date: October 17, 2026
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include "semaphore.h"
+
+typedef struct SemaphoreWaiter SemaphoreWaiter;
+
+struct SemaphoreWaiter {
+    int n; // number of requested permits
+    bool granted; // set by the granting thread, protected by the mutex
+    pthread_cond_t cond;
+    SemaphoreWaiter* next;
+};
+
+struct Semaphore {
+    atomic_int permits; // number of available permits
+    atomic_int n_waiting; // number of threads in the wait queue
+    pthread_mutex_t mutex; // protects the wait queue
+    SemaphoreWaiter* first; // wait queue, served in FIFO order
+    SemaphoreWaiter* last;
+};
+
+Semaphore* semaphore_new(int permits) {
+    require("not negative", permits >= 0);
+    Semaphore* s = xcalloc(1, sizeof(Semaphore));
+    atomic_store(&s->permits, permits);
+    atomic_store(&s->n_waiting, 0);
+    int error = pthread_mutex_init(&s->mutex, NULL);
+    panic_if(error != 0, "error %d", error);
+    return s;
+}
+
+// Releases the resources that are associated with this object. No thread may be
+// waiting on the semaphore.
+void semaphore_free(Semaphore* s) {
+    require_not_null(s);
+    require("no waiting threads", s->first == NULL);
+    int error = pthread_mutex_destroy(&s->mutex);
+    panic_if(error != 0, "error %d", error);
+    free(s);
+}
+
+// Takes n permits if that many are available. Does not consider the wait queue.
+static bool take_permits(Semaphore* s, int n) {
+    int permits = atomic_load(&s->permits);
+    while (permits >= n) {
+        if (atomic_compare_exchange_weak(&s->permits, &permits, permits - n)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Grants permits to waiters in FIFO order as long as enough permits are
+// available for the first waiter. The calling thread must hold s->mutex.
+static void grant_waiters(Semaphore* s) {
+    while (s->first != NULL) {
+        SemaphoreWaiter* w = s->first;
+        if (!take_permits(s, w->n)) break;
+        s->first = w->next;
+        if (s->first == NULL) s->last = NULL;
+        atomic_fetch_sub(&s->n_waiting, 1);
+        w->granted = true;
+        int error = pthread_cond_signal(&w->cond);
+        panic_if(error != 0, "error %d", error);
+    }
+}
+
+// Removes w from the wait queue. The calling thread must hold s->mutex.
+static void remove_waiter(Semaphore* s, SemaphoreWaiter* w) {
+    SemaphoreWaiter* prev = NULL;
+    for (SemaphoreWaiter* v = s->first; v != NULL; prev = v, v = v->next) {
+        if (v == w) {
+            if (prev == NULL) s->first = w->next; else prev->next = w->next;
+            if (s->last == w) s->last = prev;
+            atomic_fetch_sub(&s->n_waiting, 1);
+            return;
+        }
+    }
+    assert("waiter found", false);
+}
+
+// Enqueues the calling thread and waits until n permits have been granted or
+// until the deadline has passed. A NULL deadline means waiting without limit.
+// Returns true iff the permits have been granted.
+static bool acquire_slow(Semaphore* s, int n, struct timespec* deadline) {
+    SemaphoreWaiter w = {.n = n, .granted = false, .next = NULL};
+    int error = pthread_cond_init(&w.cond, NULL);
+    panic_if(error != 0, "error %d", error);
+
+    error = pthread_mutex_lock(&s->mutex);
+    panic_if(error != 0, "error %d", error);
+
+    // publish the waiter before checking the permits, such that a concurrent
+    // release either sees the waiter or this thread sees the released permits
+    atomic_fetch_add(&s->n_waiting, 1);
+    if (s->last == NULL) s->first = &w; else s->last->next = &w;
+    s->last = &w;
+    grant_waiters(s);
+
+    bool timed_out = false;
+    while (!w.granted && !timed_out) {
+        if (deadline == NULL) {
+            error = pthread_cond_wait(&w.cond, &s->mutex);
+            panic_if(error != 0, "error %d", error);
+        } else {
+            error = pthread_cond_timedwait(&w.cond, &s->mutex, deadline);
+            panic_if(error != 0 && error != ETIMEDOUT, "error %d", error);
+            timed_out = error == ETIMEDOUT;
+        }
+    }
+
+    if (!w.granted) {
+        bool was_first = s->first == &w;
+        remove_waiter(s, &w);
+        // the next waiter may have been blocked behind this one
+        if (was_first) grant_waiters(s);
+    }
+
+    error = pthread_mutex_unlock(&s->mutex);
+    panic_if(error != 0, "error %d", error);
+    error = pthread_cond_destroy(&w.cond);
+    panic_if(error != 0, "error %d", error);
+    return w.granted;
+}
+
+// Acquires a single permit. Blocks until the permit is available.
+void semaphore_acquire(Semaphore* s) {
+    semaphore_acquire_n(s, 1);
+}
+
+// Acquires n permits at once. Blocks until the permits are available. The
+// permits are granted in the order in which the threads started waiting.
+void semaphore_acquire_n(Semaphore* s, int n) {
+    require_not_null(s);
+    require("positive", n > 0);
+    if (atomic_load(&s->n_waiting) == 0 && take_permits(s, n)) return;
+    acquire_slow(s, n, NULL);
+}
+
+// Acquires a single permit if it is immediately available. Returns true iff the
+// permit has been acquired.
+bool semaphore_try_acquire(Semaphore* s) {
+    return semaphore_try_acquire_n(s, 1);
+}
+
+// Acquires n permits if they are immediately available and no other thread is
+// waiting. Never blocks. Returns true iff the permits have been acquired.
+bool semaphore_try_acquire_n(Semaphore* s, int n) {
+    require_not_null(s);
+    require("positive", n > 0);
+    return atomic_load(&s->n_waiting) == 0 && take_permits(s, n);
+}
+
+// Acquires a single permit. Waits at most timeout_ms milliseconds. Returns true
+// iff the permit has been acquired.
+bool semaphore_acquire_timed(Semaphore* s, double timeout_ms) {
+    return semaphore_acquire_n_timed(s, 1, timeout_ms);
+}
+
+// Acquires n permits at once. Waits at most timeout_ms milliseconds. Returns true
+// iff the permits have been acquired. On timeout no permits are taken.
+bool semaphore_acquire_n_timed(Semaphore* s, int n, double timeout_ms) {
+    require_not_null(s);
+    require("positive", n > 0);
+    require("not negative", timeout_ms >= 0);
+    if (atomic_load(&s->n_waiting) == 0 && take_permits(s, n)) return true;
+    if (timeout_ms == 0) return false;
+    // pthread_cond_timedwait expects an absolute time of the realtime clock
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    long int ns = deadline.tv_nsec + (long int)(timeout_ms * 1e6);
+    deadline.tv_sec += ns / 1000000000L;
+    deadline.tv_nsec = ns % 1000000000L;
+    return acquire_slow(s, n, &deadline);
+}
+
+// Returns a single permit.
+void semaphore_release(Semaphore* s) {
+    semaphore_release_n(s, 1);
+}
+
+// Returns n permits. Wakes waiting threads whose requests can now be granted.
+void semaphore_release_n(Semaphore* s, int n) {
+    require_not_null(s);
+    require("positive", n > 0);
+    atomic_fetch_add(&s->permits, n);
+    if (atomic_load(&s->n_waiting) > 0) {
+        int error = pthread_mutex_lock(&s->mutex);
+        panic_if(error != 0, "error %d", error);
+        grant_waiters(s);
+        error = pthread_mutex_unlock(&s->mutex);
+        panic_if(error != 0, "error %d", error);
+    }
+}
+
+// Returns the number of currently available permits.
+int semaphore_available(Semaphore* s) {
+    require_not_null(s);
+    return atomic_load(&s->permits);
+}
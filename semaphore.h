@@ -0,0 +1,25 @@
+/*
+@author: Michael Rohs
+@date: October 17, 2026
+*/
+
+#ifndef semaphore_h_INCLUDED
+#define semaphore_h_INCLUDED
+
+#include "util.h"
+
+typedef struct Semaphore Semaphore;
+
+Semaphore* semaphore_new(int permits);
+void semaphore_free(Semaphore* s);
+void semaphore_acquire(Semaphore* s);
+void semaphore_acquire_n(Semaphore* s, int n);
+bool semaphore_try_acquire(Semaphore* s);
+bool semaphore_try_acquire_n(Semaphore* s, int n);
+bool semaphore_acquire_timed(Semaphore* s, double timeout_ms);
+bool semaphore_acquire_n_timed(Semaphore* s, int n, double timeout_ms);
+void semaphore_release(Semaphore* s);
+void semaphore_release_n(Semaphore* s, int n);
+int semaphore_available(Semaphore* s);
+
+#endif // semaphore_h_INCLUDED
@@ -0,0 +1,257 @@
+/*
+Sorting networks for small int arrays of up to SORTNET_MAX elements. They are
+the base case of the sort engines in psort.c, which stop partitioning or merging
+at this size.
+
+The array is loaded into vector registers (8 ints per AVX2 register, 16 per
+AVX-512 register) and padded with INT_MAX to a power of two. The registers are
+then sorted by a bitonic sorting network [Batcher 1968]: In each step every
+element is compared with the element at distance j (j a power of two) and the
+two are exchanged if they are in the wrong order for the direction of their
+bitonic sequence. Steps with a distance of at least one register compare whole
+registers with vector min and max. Steps with a smaller distance permute the
+lanes of a register to bring each element next to its partner, take min and max,
+and blend the two results. The loops are fully unrolled for each register count,
+so the network runs without any branches. The lanes beyond the array are masked
+out when loading and storing. The implementation that is best for the CPU is
+selected at runtime, as in partition.c. Insertion sort is the scalar fallback.
+
+[Batcher 1968]: K. E. Batcher, Sorting Networks and their Applications, AFIPS
+Spring Joint Computer Conference, 1968
+
+@author: Michael Rohs
+@date: October 17, 2026
+*/
+
+#if 0
+#define NO_ASSERT
+#define NO_REQUIRE
+#define NO_ENSURE
+#endif
+
+#include <pthread.h>
+#include <limits.h>
+#include "sortnet.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SORTNET_X86
+#include <immintrin.h>
+#endif
+
+// Sorts a[0..n-1] by insertion sort.
+void sortnet_int_scalar(int* a, int n) {
+    require_not_null(a);
+    for (int i = 1; i < n; i++) {
+        int x = a[i];
+        int j = i - 1;
+        while (j >= 0 && a[j] > x) {
+            a[j + 1] = a[j];
+            j--;
+        }
+        a[j + 1] = x;
+    }
+}
+
+#ifdef SORTNET_X86
+
+// Whether element e takes the maximum in the step with distance j of the merge
+// of bitonic sequences of length k (all sequences end up ascending for k = n).
+#define TAKES_MAX(e, j, k) ((((e) & (j)) != 0) != (((e) & (k)) != 0))
+#define LANE_MASK(base, i, j, k) (TAKES_MAX((base) + (i), j, k) ? -1 : 0)
+
+__attribute__((target("avx2"), always_inline))
+static inline void bitonic_avx2(int* a, int n, const int R) {
+    __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i pad = _mm256_set1_epi32(INT_MAX);
+    __m256i v[8];
+    #pragma GCC unroll 8
+    for (int r = 0; r < R; r++) {
+        __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(n - 8 * r), lanes);
+        v[r] = _mm256_blendv_epi8(pad, _mm256_maskload_epi32(a + 8 * r, valid), valid);
+    }
+    // the loops have constant trip counts, so they are fully unrolled and the
+    // lane masks become constants
+    #pragma GCC unroll 6
+    for (int log_k = 1; log_k <= 6; log_k++) {
+        int k = 1 << log_k;
+        if (k > 8 * R) break;
+        #pragma GCC unroll 6
+        for (int log_j = 5; log_j >= 0; log_j--) {
+            int j = 1 << log_j;
+            if (j >= k) continue;
+            if (j >= 8) {
+                #pragma GCC unroll 8
+                for (int r = 0; r < R; r++) {
+                    int q = r ^ (j / 8);
+                    if (q < r) continue;
+                    __m256i mn = _mm256_min_epi32(v[r], v[q]);
+                    __m256i mx = _mm256_max_epi32(v[r], v[q]);
+                    bool ascending = ((8 * r) & k) == 0;
+                    v[r] = ascending ? mn : mx;
+                    v[q] = ascending ? mx : mn;
+                }
+            } else {
+                __m256i partner = _mm256_xor_si256(lanes, _mm256_set1_epi32(j));
+                #pragma GCC unroll 8
+                for (int r = 0; r < R; r++) {
+                    int b = 8 * r;
+                    __m256i takes_max = _mm256_setr_epi32(
+                        LANE_MASK(b, 0, j, k), LANE_MASK(b, 1, j, k), LANE_MASK(b, 2, j, k), LANE_MASK(b, 3, j, k),
+                        LANE_MASK(b, 4, j, k), LANE_MASK(b, 5, j, k), LANE_MASK(b, 6, j, k), LANE_MASK(b, 7, j, k));
+                    __m256i w = _mm256_permutevar8x32_epi32(v[r], partner);
+                    __m256i mn = _mm256_min_epi32(v[r], w);
+                    __m256i mx = _mm256_max_epi32(v[r], w);
+                    v[r] = _mm256_blendv_epi8(mn, mx, takes_max);
+                }
+            }
+        }
+    }
+    #pragma GCC unroll 8
+    for (int r = 0; r < R; r++) {
+        __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(n - 8 * r), lanes);
+        _mm256_maskstore_epi32(a + 8 * r, valid, v[r]);
+    }
+}
+
+__attribute__((target("avx2")))
+static void sortnet_int_avx2(int* a, int n) {
+    require_not_null(a);
+    require("valid length", 0 <= n && n <= SORTNET_MAX);
+    if (n <= 1) return;
+    if (n <= 8) bitonic_avx2(a, n, 1);
+    else if (n <= 16) bitonic_avx2(a, n, 2);
+    else if (n <= 32) bitonic_avx2(a, n, 4);
+    else bitonic_avx2(a, n, 8);
+    ensure("sorted", forall(i, n - 1, a[i] <= a[i + 1]));
+}
+
+__attribute__((target("avx512f"), always_inline))
+static inline void bitonic_avx512(int* a, int n, const int R) {
+    __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m512i pad = _mm512_set1_epi32(INT_MAX);
+    __m512i v[4];
+    #pragma GCC unroll 4
+    for (int r = 0; r < R; r++) {
+        int m = n - 16 * r;
+        __mmask16 valid = m >= 16 ? 0xffff : m <= 0 ? 0 : (__mmask16)((1u << m) - 1);
+        v[r] = _mm512_mask_loadu_epi32(pad, valid, a + 16 * r);
+    }
+    // the loops have constant trip counts, so they are fully unrolled and the
+    // lane masks become constants
+    #pragma GCC unroll 6
+    for (int log_k = 1; log_k <= 6; log_k++) {
+        int k = 1 << log_k;
+        if (k > 16 * R) break;
+        #pragma GCC unroll 6
+        for (int log_j = 5; log_j >= 0; log_j--) {
+            int j = 1 << log_j;
+            if (j >= k) continue;
+            if (j >= 16) {
+                #pragma GCC unroll 4
+                for (int r = 0; r < R; r++) {
+                    int q = r ^ (j / 16);
+                    if (q < r) continue;
+                    __m512i mn = _mm512_min_epi32(v[r], v[q]);
+                    __m512i mx = _mm512_max_epi32(v[r], v[q]);
+                    bool ascending = ((16 * r) & k) == 0;
+                    v[r] = ascending ? mn : mx;
+                    v[q] = ascending ? mx : mn;
+                }
+            } else {
+                __m512i partner = _mm512_xor_si512(lanes, _mm512_set1_epi32(j));
+                #pragma GCC unroll 4
+                for (int r = 0; r < R; r++) {
+                    __mmask16 takes_max = 0;
+                    #pragma GCC unroll 16
+                    for (int i = 0; i < 16; i++) {
+                        if (TAKES_MAX(16 * r + i, j, k)) takes_max |= 1 << i;
+                    }
+                    __m512i w = _mm512_permutexvar_epi32(partner, v[r]);
+                    __m512i mn = _mm512_min_epi32(v[r], w);
+                    __m512i mx = _mm512_max_epi32(v[r], w);
+                    v[r] = _mm512_mask_blend_epi32(takes_max, mn, mx);
+                }
+            }
+        }
+    }
+    #pragma GCC unroll 4
+    for (int r = 0; r < R; r++) {
+        int m = n - 16 * r;
+        __mmask16 valid = m >= 16 ? 0xffff : m <= 0 ? 0 : (__mmask16)((1u << m) - 1);
+        _mm512_mask_storeu_epi32(a + 16 * r, valid, v[r]);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void sortnet_int_avx512(int* a, int n) {
+    require_not_null(a);
+    require("valid length", 0 <= n && n <= SORTNET_MAX);
+    if (n <= 1) return;
+    if (n <= 16) bitonic_avx512(a, n, 1);
+    else if (n <= 32) bitonic_avx512(a, n, 2);
+    else bitonic_avx512(a, n, 4);
+    ensure("sorted", forall(i, n - 1, a[i] <= a[i + 1]));
+}
+
+#endif // SORTNET_X86
+
+typedef void (*SortnetFunc)(int* a, int n);
+
+static pthread_once_t sortnet_once = PTHREAD_ONCE_INIT;
+static SortnetFunc sortnet_selected = sortnet_int_scalar;
+static const char* sortnet_selected_isa = "scalar";
+
+// Selects the best implementation that the CPU supports.
+static void init_sortnet(void) {
+#ifdef SORTNET_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        sortnet_selected = sortnet_int_avx512;
+        sortnet_selected_isa = "avx512";
+    } else if (__builtin_cpu_supports("avx2")) {
+        sortnet_selected = sortnet_int_avx2;
+        sortnet_selected_isa = "avx2";
+    }
+#endif
+}
+
+// Sorts a[0..n-1] in ascending order. n must not exceed SORTNET_MAX.
+void sortnet_int(int* a, int n) {
+    int error = pthread_once(&sortnet_once, init_sortnet);
+    panic_if(error != 0, "error %d", error);
+    sortnet_selected(a, n);
+}
+
+// Returns the name of the instruction set that sortnet_int uses.
+const char* sortnet_isa(void) {
+    int error = pthread_once(&sortnet_once, init_sortnet);
+    panic_if(error != 0, "error %d", error);
+    return sortnet_selected_isa;
+}
+
+// Overrides the automatic selection, e.g., for benchmarking. isa is one of
+// "avx512", "avx2", or "scalar". Returns false if the CPU does not support the
+// requested instruction set, in which case the selection is not changed.
+bool sortnet_use(const char* isa) {
+    require_not_null(isa);
+    int error = pthread_once(&sortnet_once, init_sortnet);
+    panic_if(error != 0, "error %d", error);
+    if (strcmp(isa, "scalar") == 0) {
+        sortnet_selected = sortnet_int_scalar;
+        sortnet_selected_isa = "scalar";
+        return true;
+    }
+#ifdef SORTNET_X86
+    if (strcmp(isa, "avx512") == 0 && __builtin_cpu_supports("avx512f")) {
+        sortnet_selected = sortnet_int_avx512;
+        sortnet_selected_isa = "avx512";
+        return true;
+    }
+    if (strcmp(isa, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        sortnet_selected = sortnet_int_avx2;
+        sortnet_selected_isa = "avx2";
+        return true;
+    }
+#endif
+    return false;
+}
@@ -0,0 +1,19 @@
+/*
+@author: Michael Rohs
+@date: October 17, 2026
+*/
+
+#ifndef sortnet_h_INCLUDED
+#define sortnet_h_INCLUDED
+
+#include "util.h"
+
+// Maximum number of elements that sortnet_int sorts.
+#define SORTNET_MAX 64
+
+void sortnet_int(int* a, int n);
+void sortnet_int_scalar(int* a, int n);
+const char* sortnet_isa(void);
+bool sortnet_use(const char* isa);
+
+#endif // sortnet_h_INCLUDED
@@ -0,0 +1,77 @@
+#include <limits.h>
+#include "sortnet.h"
+
+int compare_int(const void* x, const void* y) {
+    int a = *(const int*)x, b = *(const int*)y;
+    return (a > b) - (a < b);
+}
+
+// Sorts arrays of all lengths up to SORTNET_MAX, including duplicates and the
+// extreme values, and checks that the elements behind the array are untouched.
+void test_sortnet(char* isa) {
+    if (!sortnet_use(isa)) {
+        printf("%s not supported\n", isa);
+        return;
+    }
+    int a[SORTNET_MAX + 8], b[SORTNET_MAX + 8];
+    bool ok = true;
+    for (int n = 0; n <= SORTNET_MAX && ok; n++) {
+        for (int range = 1; range <= 1000000 && ok; range *= 10) {
+            for (int r = 0; r < 20 && ok; r++) {
+                for (int i = 0; i < SORTNET_MAX + 8; i++) a[i] = i_rnd(range) - range / 2;
+                if (n > 2 && r % 2 == 0) {
+                    a[i_rnd(n)] = INT_MAX;
+                    a[i_rnd(n)] = INT_MIN;
+                }
+                memcpy(b, a, sizeof(a));
+                sortnet_int(a, n);
+                qsort(b, n, sizeof(int), compare_int);
+                ok = memcmp(a, b, sizeof(a)) == 0;
+                if (!ok) printf("%s failed: n = %d, range = %d\n", isa, n, range);
+            }
+        }
+    }
+    test_equal_i(ok, true);
+}
+
+// Returns the time in nanoseconds per sorted array of n elements.
+double bench_sortnet(int n) {
+    int n_arrays = 1000000 / SORTNET_MAX;
+    int* data = xmalloc(n_arrays * SORTNET_MAX * sizeof(int));
+    int* a = xmalloc(n_arrays * SORTNET_MAX * sizeof(int));
+    for (int i = 0; i < n_arrays * SORTNET_MAX; i++) data[i] = i_rnd(1000000);
+    double best = 0;
+    for (int r = 0; r < 5; r++) {
+        memcpy(a, data, n_arrays * SORTNET_MAX * sizeof(int));
+        timespec start = time_now();
+        for (int i = 0; i < n_arrays; i++) sortnet_int(a + i * SORTNET_MAX, n);
+        double ms = time_ms_since(start);
+        if (r == 0 || ms < best) best = ms;
+    }
+    free(a);
+    free(data);
+    return 1e6 * best / n_arrays;
+}
+
+// Run with argument "bench" to measure the time per array for each
+// implementation. This needs an optimized build.
+int main(int argc, char* argv[]) {
+    if (argc < 2 || strcmp(argv[1], "bench") != 0) {
+        test_sortnet("scalar");
+        test_sortnet("avx2");
+        test_sortnet("avx512");
+        return 0;
+    }
+    char* isas[] = {"scalar", "avx2", "avx512"};
+    int ns[] = {8, 16, 32, 64};
+    printf("%8s", "ns/array");
+    for (int i = 0; i < 4; i++) printf(" %8d", ns[i]);
+    printf("\n");
+    for (int s = 0; s < 3; s++) {
+        if (!sortnet_use(isas[s])) continue;
+        printf("%8s", isas[s]);
+        for (int i = 0; i < 4; i++) printf(" %8.1f", bench_sortnet(ns[i]));
+        printf("\n");
+    }
+    return 0;
+}
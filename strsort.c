@@ -0,0 +1,276 @@
+/*
+Parallel sort for arrays of Strings, e.g., the lines of a file from split_lines.
+The Strings are views into the text, so only the views are moved, never the
+characters. Strings are ordered like memcmp orders their bytes, and a String
+that is a prefix of another String comes first.
+
+The sort is a multikey quicksort [Bentley, Sedgewick 1997] with cached keys.
+Each interval of the array has a depth d: all its strings have the same first d
+bytes. Next to the array of Strings is an array of 64-bit keys, one per String,
+which holds the STRSORT_KEY_BYTES bytes of the String from position d on, in the
+upper bytes in big-endian order, and the number of these bytes in the lowest
+byte. Comparing two keys as integers thus compares the next 7 bytes of the
+Strings, and a String that ends within them compares less than its extensions.
+The keys are loaded once per depth and the partitioning then only touches the
+key array and moves the Strings along, which avoids a pointer dereference and a
+cache miss per comparison.
+
+Partitioning is three-way around a pivot key (median of three, or Tukey's
+ninther for large intervals). The parts with smaller and larger keys keep their
+depth and their keys. The part with keys equal to the pivot is done if the
+pivot's strings end within the key. Otherwise all its strings share 7 more
+bytes, so its depth grows by 7 and its keys are reloaded. Small intervals are
+sorted by insertion sort, which compares keys first and the rest of the
+Strings only if the keys are equal. As in psort, each interval carries a budget
+of unbalanced splits, and an interval that used it up is sorted by heapsort.
+
+As in psort.c, intervals are sent as tasks to a pool of worker threads (see
+PSortPool), which also loads the first keys in parallel, and a countdown of the
+strings that reached their final position determines when the sort is done.
+Intervals with fewer than grain_size strings are sorted sequentially by the
+worker that produced them.
+
+[Bentley, Sedgewick 1997]: J. L. Bentley, R. Sedgewick, Fast Algorithms for
+Sorting and Searching Strings, SODA 1997
+
+@author: Michael Rohs
+@date: October 17, 2026
+*/
+
+#if 0
+#define NO_ASSERT
+#define NO_REQUIRE
+#define NO_ENSURE
+#endif
+
+#include "strsort.h"
+
+// Compares x and y by their bytes (as unsigned chars). A prefix is less than the
+// longer string. Returns a negative number, zero, or a positive number.
+int strsort_compare(String x, String y) {
+    int m = x.len < y.len ? x.len : y.len;
+    int c = m > 0 ? memcmp(x.s, y.s, m) : 0;
+    return c != 0 ? c : (x.len > y.len) - (x.len < y.len);
+}
+
+// Compares x and y like strsort_compare, starting at position depth.
+static inline int compare_from(String x, String y, long int depth) {
+    int m = x.len < y.len ? x.len : y.len;
+    int c = m > depth ? memcmp(x.s + depth, y.s + depth, m - depth) : 0;
+    return c != 0 ? c : (x.len > y.len) - (x.len < y.len);
+}
+
+// Returns the key of s at depth, which must not exceed the length of s.
+static inline uint64_t str_key(String s, long int depth) {
+    long int rest = s.len - depth;
+    if (rest > STRSORT_KEY_BYTES) {
+        uint64_t w;
+        memcpy(&w, s.s + depth, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        w = __builtin_bswap64(w);
+#endif
+        return (w & ~(uint64_t)0xff) | STRSORT_KEY_BYTES;
+    }
+    uint64_t k = 0;
+    for (int i = 0; i < rest; i++) k |= (uint64_t)(unsigned char)s.s[depth + i] << (56 - 8 * i);
+    return k | (uint64_t)rest;
+}
+
+// Whether the strings with key k end within the key, i.e., all strings with this
+// key are equal.
+static inline bool is_final(uint64_t k) {
+    return (k & 0xff) < STRSORT_KEY_BYTES;
+}
+
+static inline void load_keys(const String* a, uint64_t* keys, long int low, long int high, long int depth) {
+    for (long int i = low; i <= high; i++) keys[i] = str_key(a[i], depth);
+}
+
+static inline void swap(String* a, uint64_t* keys, long int i, long int j) {
+    String h = a[i]; a[i] = a[j]; a[j] = h;
+    uint64_t k = keys[i]; keys[i] = keys[j]; keys[j] = k;
+}
+
+// Compares the strings with keys at depth.
+static inline bool str_less(String x, uint64_t kx, String y, uint64_t ky, long int depth) {
+    if (kx != ky) return kx < ky;
+    if (is_final(kx)) return false;
+    return compare_from(x, y, depth + STRSORT_KEY_BYTES) < 0;
+}
+
+static void insertion_sort(String* a, uint64_t* keys, long int low, long int high, long int depth) {
+    for (long int i = low + 1; i <= high; i++) {
+        String x = a[i];
+        uint64_t k = keys[i];
+        long int j = i - 1;
+        while (j >= low && str_less(x, k, a[j], keys[j], depth)) {
+            a[j + 1] = a[j];
+            keys[j + 1] = keys[j];
+            j--;
+        }
+        a[j + 1] = x;
+        keys[j + 1] = k;
+    }
+}
+
+static void sift_down(String* a, uint64_t* keys, long int low, long int i, long int n, long int depth) {
+    while (true) {
+        long int c = 2 * i + 1;
+        if (c >= n) return;
+        if (c + 1 < n && str_less(a[low + c], keys[low + c], a[low + c + 1], keys[low + c + 1], depth)) c++;
+        if (!str_less(a[low + i], keys[low + i], a[low + c], keys[low + c], depth)) return;
+        swap(a, keys, low + i, low + c);
+        i = c;
+    }
+}
+
+static void heapsort_keys(String* a, uint64_t* keys, long int low, long int high, long int depth) {
+    long int n = high - low + 1;
+    for (long int i = n / 2 - 1; i >= 0; i--) sift_down(a, keys, low, i, n, depth);
+    for (long int m = n - 1; m > 0; m--) {
+        swap(a, keys, low, low + m);
+        sift_down(a, keys, low, 0, m, depth);
+    }
+}
+
+static inline uint64_t median3(uint64_t x, uint64_t y, uint64_t z) {
+    if (x < y) return y < z ? y : x < z ? z : x;
+    return x < z ? x : y < z ? z : y;
+}
+
+// Returns the pivot key of keys[low..high].
+static uint64_t pivot_key(const uint64_t* keys, long int low, long int high) {
+    long int n = high - low + 1;
+    long int mid = low + n / 2;
+    if (n < PSORT_NINTHER_SIZE) return median3(keys[low], keys[mid], keys[high]);
+    long int d = n / 8;
+    return median3(median3(keys[low], keys[low + d], keys[low + 2 * d]),
+                   median3(keys[mid - d], keys[mid], keys[mid + d]),
+                   median3(keys[high - 2 * d], keys[high - d], keys[high]));
+}
+
+// Partitions a[low..high] three-way by key (Dijkstra). Afterwards the keys in
+// [low, *lt) are less than the pivot, the keys in [*lt, *gt] equal to it, and the
+// keys in (*gt, high] greater than it.
+static void partition_keys(String* a, uint64_t* keys, long int low, long int high, long int* lt, long int* gt) {
+    uint64_t p = pivot_key(keys, low, high);
+    long int l = low, i = low, g = high;
+    while (i <= g) {
+        uint64_t k = keys[i];
+        if (k < p) swap(a, keys, l++, i++);
+        else if (k > p) swap(a, keys, i, g--);
+        else i++;
+    }
+    *lt = l;
+    *gt = g;
+}
+
+static void sort_sequential(String* a, uint64_t* keys, long int low, long int high, long int depth, int budget) {
+    while (high - low + 1 > STRSORT_INSERTION_SIZE) {
+        if (budget <= 0) {
+            heapsort_keys(a, keys, low, high, depth);
+            return;
+        }
+        long int lt, gt;
+        partition_keys(a, keys, low, high, &lt, &gt);
+        if (psort_is_unbalanced(high - low + 1, lt - low, high - gt)) budget--;
+        sort_sequential(a, keys, low, lt - 1, depth, budget);
+        sort_sequential(a, keys, gt + 1, high, depth, budget);
+        if (is_final(keys[lt])) return;
+        low = lt;
+        high = gt;
+        depth += STRSORT_KEY_BYTES;
+        load_keys(a, keys, low, high, depth);
+        budget = psort_split_budget(high - low + 1);
+    }
+    insertion_sort(a, keys, low, high, depth);
+}
+
+typedef struct {
+    String* a;
+    uint64_t* keys;
+    PSortPool* pool;
+    Countdown* c;
+    const PSortOptions* opts;
+} StrSortArgs;
+
+static void run_interval(const PSortTask* t);
+
+static void schedule(StrSortArgs* s, long int low, long int high, long int depth, int budget) {
+    long int n = high - low + 1;
+    if (n <= 0) return;
+    if (n == 1 || n < s->opts->grain_size || budget <= 0) {
+        sort_sequential(s->a, s->keys, low, high, depth, budget);
+        countdown_sub(s->c, n);
+        return;
+    }
+    psort_pool_send(s->pool, (PSortTask){.run = run_interval, .shared = s, .low = low, .high = high, .depth = depth, .budget = budget});
+}
+
+static void run_interval(const PSortTask* t) {
+    StrSortArgs* s = t->shared;
+    long int low = t->low, high = t->high, depth = t->depth;
+    int budget = t->budget;
+    long int lt, gt;
+    partition_keys(s->a, s->keys, low, high, &lt, &gt);
+    if (psort_is_unbalanced(high - low + 1, lt - low, high - gt)) budget--;
+    schedule(s, low, lt - 1, depth, budget);
+    schedule(s, gt + 1, high, depth, budget);
+    if (is_final(s->keys[lt])) {
+        countdown_sub(s->c, gt - lt + 1);
+    } else {
+        load_keys(s->a, s->keys, lt, gt, depth + STRSORT_KEY_BYTES);
+        schedule(s, lt, gt, depth + STRSORT_KEY_BYTES, psort_split_budget(gt - lt + 1));
+    }
+}
+
+typedef struct {
+    PSortBlocks b;
+    const String* a;
+    uint64_t* keys;
+} ParallelKeys;
+
+static void* load_keys_block(void* arg) {
+    PSortBlockArg* ba = arg;
+    ParallelKeys* pk = ba->shared;
+    PSortRange r = pk->b.blocks[ba->t];
+    load_keys(pk->a, pk->keys, r.begin, r.end - 1, 0);
+    return NULL;
+}
+
+// Sorts the n Strings of a in ascending order of strsort_compare. Only the
+// Strings are moved, not the characters they point to. The sort is not stable.
+void strsort(String* a, size_t n, const PSortOptions* opts) {
+    require("valid array", a != NULL || n == 0);
+    require("valid size", n <= LONG_MAX);
+    PSortOptions o = psort_resolve_options(opts);
+    if (n < 2) return;
+    uint64_t* keys = xmalloc(n * sizeof(uint64_t));
+    if (o.n_threads == 1 || (long int)n < o.grain_size) {
+        load_keys(a, keys, 0, (long int)n - 1, 0);
+        sort_sequential(a, keys, 0, (long int)n - 1, 0, psort_split_budget(n));
+    } else {
+        PSortPool* pool = psort_pool_new(o.n_threads);
+        int n_blocks = n >= PSORT_PARALLEL_PARTITION_SIZE ? o.n_threads : 1;
+        ParallelKeys* pk = xmalloc(sizeof(ParallelKeys));
+        pk->a = a;
+        pk->keys = keys;
+        psort_split_blocks(&pk->b, 0, (long int)n, n_blocks);
+        psort_run_on_pool(pool, pk, n_blocks, load_keys_block);
+        free(pk);
+        Countdown* c = countdown_new((long int)n);
+        StrSortArgs s = {a, keys, pool, c, &o};
+        schedule(&s, 0, (long int)n - 1, 0, psort_split_budget(n));
+        countdown_wait(c);
+        psort_pool_free(pool);
+        countdown_free(c);
+    }
+    free(keys);
+    ensure("sorted", forall_x(long int i = 0, i < (long int)n - 1, i++, strsort_compare(a[i], a[i + 1]) <= 0));
+}
+
+// Sorts the Strings of arr, e.g., the lines from split_lines.
+void strsort_array(StringArray* arr, const PSortOptions* opts) {
+    require_not_null(arr);
+    strsort(arr->a, arr->len, opts);
+}
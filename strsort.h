@@ -0,0 +1,19 @@
+/*
+@author: Michael Rohs
+@date: October 17, 2026
+*/
+
+#ifndef strsort_h_INCLUDED
+#define strsort_h_INCLUDED
+
+#include "util.h"
+#include "psort.h"
+
+#define STRSORT_KEY_BYTES 7
+#define STRSORT_INSERTION_SIZE 16
+
+int strsort_compare(String x, String y);
+void strsort(String* a, size_t n, const PSortOptions* opts);
+void strsort_array(StringArray* arr, const PSortOptions* opts);
+
+#endif // strsort_h_INCLUDED
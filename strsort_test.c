@@ -0,0 +1,178 @@
+#include "strsort.h"
+
+int compare_string(const void* x, const void* y) {
+    return strsort_compare(*(const String*)x, *(const String*)y);
+}
+
+// Returns whether a and b contain the same strings in the same order.
+bool equal_strings(const String* a, const String* b, long int n) {
+    return forall_x(long int i = 0, i < n, i++, strsort_compare(a[i], b[i]) == 0);
+}
+
+// Sorts a copy of the n strings with strsort and with qsort and compares the
+// results.
+void check_sort(const String* strings, long int n, int n_threads, long int grain_size) {
+    String* a = xmalloc((n + 1) * sizeof(String));
+    String* b = xmalloc((n + 1) * sizeof(String));
+    memcpy(a, strings, n * sizeof(String));
+    memcpy(b, strings, n * sizeof(String));
+    PSortOptions opts = psort_options();
+    opts.n_threads = n_threads;
+    opts.grain_size = grain_size;
+    strsort(a, n, &opts);
+    qsort(b, n, sizeof(String), compare_string);
+    test_equal_i(equal_strings(a, b, n), true);
+    free(b);
+    free(a);
+}
+
+// Generates n log lines into text, which must have room for n * 128 bytes, and
+// returns them as views into text.
+String* generate_log_lines(char* text, long int n) {
+    static const char* levels[] = {"INFO", "WARN", "ERROR", "DEBUG"};
+    static const char* paths[] = {"/api/v1/items", "/api/v1/users", "/api/v2/orders", "/static/app.js"};
+    String* lines = xmalloc((n + 1) * sizeof(String));
+    char* t = text;
+    for (long int i = 0; i < n; i++) {
+        long int ms = i * 7 + i_rnd(1000);
+        int len = sprintf(t, "2026-10-17T%02ld:%02ld:%02ld.%03ldZ %s [worker-%d] GET %s/%d status=%d took=%dms",
+                          ms / 3600000 % 24, ms / 60000 % 60, ms / 1000 % 60, ms % 1000, levels[i_rnd(4)],
+                          i_rnd(64), paths[i_rnd(4)], i_rnd(100000), i_rnd(10) == 0 ? 404 : 200, i_rnd(500));
+        lines[i] = make_string2(t, len);
+        t += len + 1;
+    }
+    return lines;
+}
+
+void test_small(void) {
+    check_sort(NULL, 0, 4, 32);
+    String one[] = {make_string("x")};
+    check_sort(one, 1, 4, 32);
+
+    // prefixes, empty strings, equal strings, and bytes above 127
+    String words[] = {
+        make_string("banana"), make_string(""), make_string("ban"), make_string("bananas"),
+        make_string("apple"), make_string("banana"), make_string(""), make_string("\xff\xfe"),
+        make_string("b"), make_string("abcdefgh"), make_string("abcdefg"), make_string("abcdefghi"),
+        make_string("abcdefgh"), make_string("\x7f"), make_string("a"), make_string("abcdefgX"),
+    };
+    int n = sizeof(words) / sizeof(words[0]);
+    check_sort(words, n, 1, 32);
+    check_sort(words, n, 4, 2);
+
+    // embedded zero bytes sort before the end of a longer string, after its prefix
+    String zeros[] = {make_string2("ab\0\0\0\0\0\0\0c", 10), make_string2("ab", 2), make_string2("ab\0", 3),
+                      make_string2("ab\0\0\0\0\0\0\0", 9), make_string2("ab\0\0\0\0\0\0\0\0", 10)};
+    check_sort(zeros, 5, 1, 32);
+    String a[5];
+    memcpy(a, zeros, sizeof(a));
+    strsort(a, 5, NULL);
+    test_equal_i(a[0].len == 2 && a[1].len == 3 && a[2].len == 9, true);
+    test_equal_i(a[3].len == 10 && a[3].s[9] == 0 && a[4].s[9] == 'c', true);
+}
+
+// Sorts random strings with long common prefixes and many duplicates, so that
+// intervals go through several depths.
+void test_random(void) {
+    long int n = 200000;
+    char* text = xmalloc(n * 64);
+    String* strings = xmalloc(n * sizeof(String));
+    for (long int i = 0; i < n; i++) {
+        char* t = text + i * 64;
+        int prefix = i_rnd(4) * 8;
+        memset(t, 'p', prefix);
+        int len = prefix + i_rnd(12);
+        for (int j = prefix; j < len; j++) t[j] = 'a' + i_rnd(3);
+        strings[i] = make_string2(t, len);
+    }
+    check_sort(strings, n, 1, 32);
+    check_sort(strings, n, 4, 32);
+    check_sort(strings, n, 3, 1000);
+    free(strings);
+    free(text);
+}
+
+// Sorts the lines of a text from split_lines.
+void test_lines(void) {
+    long int n = 100000;
+    char* text = xmalloc(n * 128);
+    String* lines = generate_log_lines(text, n);
+    String joined = new_string(n * 128);
+    for (long int i = 0; i < n; i++) {
+        xappend_string(&joined, lines[i]);
+        xappend_char(&joined, '\n');
+    }
+    StringArray* arr = split_lines(joined.s);
+    test_equal_i(arr->len, n + 1);
+    strsort_array(arr, NULL);
+    test_equal_i(arr->a[0].len, 0);
+    test_equal_i(forall(i, arr->len - 1, strsort_compare(arr->a[i], arr->a[i + 1]) <= 0), true);
+    check_sort(lines, n, 4, 32);
+    free(arr);
+    free(joined.s);
+    free(lines);
+    free(text);
+}
+
+// Compares strsort with all threads and with one thread with qsort on n
+// generated log lines.
+void benchmark(long int n, int n_threads) {
+    char* text = xmalloc(n * 128);
+    String* lines = generate_log_lines(text, n);
+    String* a = xmalloc(n * sizeof(String));
+    printf("lines = %ld, threads = %d\n", n, n_threads);
+    printf("%10s %12s\n", "method", "best ms");
+    char* names[] = {"strsort", "sequential", "qsort"};
+    for (int m = 0; m < 3; m++) {
+        PSortOptions opts = psort_options();
+        opts.n_threads = m == 0 ? n_threads : 1;
+        double best = 0;
+        for (int r = 0; r < 3; r++) {
+            memcpy(a, lines, n * sizeof(String));
+            timespec start = time_now();
+            if (m < 2) strsort(a, n, &opts);
+            else qsort(a, n, sizeof(String), compare_string);
+            double ms = time_ms_since(start);
+            if (r == 0 || ms < best) best = ms;
+        }
+        panic_if(!forall_x(long int i = 0, i < n - 1, i++, strsort_compare(a[i], a[i + 1]) <= 0), "not sorted");
+        printf("%10s %12.1f\n", names[m], best);
+    }
+    free(a);
+    free(lines);
+    free(text);
+}
+
+// Without arguments, runs the tests. Otherwise benchmarks the sort of generated
+// log lines, or sorts the lines of a file and prints them:
+//
+//     strsort_test bench [n_lines [threads]]
+//     strsort_test sort file [threads]
+int main(int argc, char* argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+        long int n = argc >= 3 ? atol(argv[2]) : 4000000;
+        int n_threads = argc >= 4 ? atoi(argv[3]) : psort_options().n_threads;
+        exit_if(n <= 0 || n_threads <= 0, "usage: strsort_test bench [n_lines [threads]]");
+        benchmark(n, n_threads);
+        return 0;
+    }
+    if (argc >= 3 && strcmp(argv[1], "sort") == 0) {
+        PSortOptions opts = psort_options();
+        if (argc >= 4) opts.n_threads = atoi(argv[3]);
+        exit_if(opts.n_threads <= 0, "usage: strsort_test sort file [threads]");
+        String text = read_file(argv[2]);
+        StringArray* lines = split_lines(text.s);
+        timespec start = time_now();
+        strsort_array(lines, &opts);
+        double ms = time_ms_since(start);
+        for (int i = 0; i < lines->len; i++) println_string(lines->a[i]);
+        fprintf(stderr, "lines = %d, time = %.1f ms\n", lines->len, ms);
+        free(lines);
+        free(text.s);
+        return 0;
+    }
+    test_small();
+    test_random();
+    test_lines();
+    return 0;
+}
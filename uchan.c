@@ -4,6 +4,19 @@ between multiple threads. UChan is implemented using pthreads [pthreads
 Wikipedia][pthreads OpenGroup]. It differs from Go channels [Go channels] in
 that it does not have a fixed capacity.
 
+The values are kept in a VQueue, which grows by blocks. A sender that finds the
+queue's last block full allocates the next block after releasing the mutex and
+hands it to the queue when it has locked the mutex again, and a receiver frees
+the blocks that the queue no longer needs after releasing the mutex. So no
+thread holds the mutex while it waits for the allocator.
+
+A channel created by uchan_new_sized transports values of a fixed size, e.g.,
+small structs, which are copied into the queue's blocks, so the sender does not
+need to allocate a box for each value and the receiver does not need to free it.
+uchan_send_elem and uchan_receive2_elem copy such values in and out, and
+generate_uchan in uchan.h defines typed wrappers. uchan_select only supports
+channels of pointers.
+
 Guarantees of the channel API:
 - FIFO behavior: order sent (from the same thread) equals order received
 - no order specification for sends from different threads (*);
@@ -57,8 +70,9 @@ struct UChan {
     pthread_cond_t no_waiting_receivers;
 };
 
-// Creates a channel.
-UChan* uchan_new(void) {
+// Creates a channel for values of elem_size bytes, which are stored in the
+// channel by value.
+UChan* uchan_new_sized(size_t elem_size) {
     int error;
 
     if (key_chan_select_item == 0) {
@@ -77,11 +91,16 @@ UChan* uchan_new(void) {
     error = pthread_cond_init(&ch->no_waiting_receivers, NULL);
     panic_if(error != 0, "error %d", error);
 
-    ch->queue = vqueue_new();
+    ch->queue = vqueue_new_sized(elem_size);
 
     return ch;
 }
 
+// Creates a channel for pointers.
+UChan* uchan_new(void) {
+    return uchan_new_sized(sizeof(void*));
+}
+
 // Frees the resources associated with this channel.
 void uchan_free(UChan* ch) {
     require_not_null(ch);
@@ -110,17 +129,44 @@ void uchan_free(UChan* ch) {
     free(ch);
 }
 
-// Sends x to the given channel. x is allowed to be NULL.
+// Makes sure that the queue can take n more values without allocating. The
+// mutex must be locked. The blocks are allocated outside of the critical
+// section, so that the allocator's latency does not block the other senders and
+// receivers. Panics if the channel is closed.
+static void reserve_blocks(UChan* ch, long int n) {
+    panic_if(ch->closed, "send on closed channel");
+    long int needed;
+    while ((needed = vqueue_blocks_needed(ch->queue, n)) > 0) {
+        int error = pthread_mutex_unlock(&ch->mutex);
+        panic_if(error != 0, "error %d", error);
+        VQueueBlock* blocks = NULL;
+        for (long int i = 0; i < needed; i++) {
+            VQueueBlock* b = vqueue_new_block(ch->queue);
+            b->next = blocks;
+            blocks = b;
+        }
+        error = pthread_mutex_lock(&ch->mutex);
+        panic_if(error != 0, "error %d", error);
+        panic_if(ch->closed, "send on closed channel");
+        while (blocks != NULL) {
+            VQueueBlock* b = blocks;
+            blocks = b->next;
+            vqueue_add_block(ch->queue, b);
+        }
+    }
+}
+
+// Sends a copy of the value at x to the given channel.
 // Panics if the channel is already closed.
-void uchan_send(UChan* ch, /*in*/void* x) {
+void uchan_send_elem(UChan* ch, /*in*/const void* x) {
     require_not_null(ch);
+    require_not_null(x);
 
     int error = pthread_mutex_lock(&ch->mutex);
     panic_if(error != 0, "error %d", error);
 
-    panic_if(ch->closed, "send on closed channel");
-
-    vqueue_put(ch->queue, x);
+    reserve_blocks(ch, 1);
+    vqueue_put_elem(ch->queue, x);
 
     error = pthread_cond_broadcast(&ch->waiting_receivers);
     panic_if(error != 0, "error %d", error);
@@ -129,13 +175,20 @@ void uchan_send(UChan* ch, /*in*/void* x) {
     panic_if(error != 0, "error %d", error);
 }
 
-// Receives a value from the channel and writes it to x. Blocks until a value is
+// Sends x to the given channel, which must be a channel for pointers. x is
+// allowed to be NULL. Panics if the channel is already closed.
+void uchan_send(UChan* ch, /*in*/void* x) {
+    require_not_null(ch);
+    require("pointer channel", ch->queue->elem_size == sizeof(void*));
+    uchan_send_elem(ch, &x);
+}
+
+// Receives a value from the channel and copies it to x. Blocks until a value is
 // available. If the channel is already closed, returns values that are still in
 // the channel. If the channel is closed and there are no more values in the
-// channel, writes NULL to x. Returns true iff there was a value in the channel.
-// (*x == NULL is not an indication of the end of the channel, because NULL values
-// are allowed.)
-bool uchan_receive2(UChan* ch, /*out*/void** x) {
+// channel, fills x with zero bytes. Returns true iff there was a value in the
+// channel.
+bool uchan_receive2_elem(UChan* ch, /*out*/void* x) {
     require_not_null(ch);
     require_not_null(x);
 
@@ -155,10 +208,11 @@ bool uchan_receive2(UChan* ch, /*out*/void** x) {
 
     assert("not closed implies queue not empty", ch->closed || !vqueue_empty(ch->queue));
     bool has_value = !vqueue_empty(ch->queue);
+    VQueueBlock* retired = NULL;
     if (has_value) {
-        *x = vqueue_get(ch->queue);
+        vqueue_get_elem_deferred(ch->queue, x, &retired);
     } else {
-        *x = NULL;
+        memset(x, 0, ch->queue->elem_size);
     }
 
     if (ch->finishing && ch->n_waiting_receivers <= 0) {
@@ -168,10 +222,79 @@ bool uchan_receive2(UChan* ch, /*out*/void** x) {
 
     error = pthread_mutex_unlock(&ch->mutex);
     panic_if(error != 0, "error %d", error);
+    vqueue_free_blocks(retired);
 
     return has_value;
 }
 
+// Receives a value from the channel, which must be a channel for pointers, and
+// writes it to x. Blocks until a value is available. If the channel is already
+// closed, returns values that are still in the channel. If the channel is closed
+// and there are no more values in the channel, writes NULL to x. Returns true iff
+// there was a value in the channel. (*x == NULL is not an indication of the end
+// of the channel, because NULL values are allowed.)
+bool uchan_receive2(UChan* ch, /*out*/void** x) {
+    require_not_null(ch);
+    require("pointer channel", ch->queue->elem_size == sizeof(void*));
+    return uchan_receive2_elem(ch, x);
+}
+
+// Sends the n values of the array xs to the given channel, in order and without
+// values of other senders in between. Panics if the channel is already closed.
+void uchan_send_n(UChan* ch, /*in*/const void* xs, long int n) {
+    require_not_null(ch);
+    require("valid values", xs != NULL || n == 0);
+    require("not negative", n >= 0);
+
+    int error = pthread_mutex_lock(&ch->mutex);
+    panic_if(error != 0, "error %d", error);
+
+    reserve_blocks(ch, n);
+    vqueue_put_n(ch->queue, xs, n);
+
+    error = pthread_cond_broadcast(&ch->waiting_receivers);
+    panic_if(error != 0, "error %d", error);
+
+    error = pthread_mutex_unlock(&ch->mutex);
+    panic_if(error != 0, "error %d", error);
+}
+
+// Receives up to n values from the channel into the array xs and returns their
+// number.
+// Blocks until at least one value is available. If the channel is closed and
+// there are no more values in the channel, returns 0. Cannot be used with
+// uchan_select.
+long int uchan_receive_n(UChan* ch, /*out*/void* xs, long int n) {
+    require_not_null(ch);
+    require_not_null(xs);
+    require("positive", n > 0);
+
+    int error = pthread_mutex_lock(&ch->mutex);
+    panic_if(error != 0, "error %d", error);
+
+    ch->n_waiting_receivers++;
+    while (vqueue_empty(ch->queue) && !ch->closed) {
+        error = pthread_cond_wait(&ch->waiting_receivers, &ch->mutex);
+        panic_if(error != 0, "error %d", error);
+    }
+    ch->n_waiting_receivers--;
+    assert("not negative", ch->n_waiting_receivers >= 0);
+
+    VQueueBlock* retired = NULL;
+    n = vqueue_get_n_deferred(ch->queue, xs, n, &retired);
+
+    if (ch->finishing && ch->n_waiting_receivers <= 0) {
+        error = pthread_cond_signal(&ch->no_waiting_receivers);
+        panic_if(error != 0, "error %d", error);
+    }
+
+    error = pthread_mutex_unlock(&ch->mutex);
+    panic_if(error != 0, "error %d", error);
+    vqueue_free_blocks(retired);
+
+    return n;
+}
+
 // Receives a value from the channel. Blocks until a value is available. If the
 // channel is already closed, returns values that are still in the channel. If the
 // channel is closed and there are no more values in the channel, returns NULL.
@@ -233,13 +356,13 @@ void uchan_close(UChan* ch) {
 }
 
 // Returns the number of values that are currently in the channel.
-int uchan_len(UChan* ch) {
+long int uchan_len(UChan* ch) {
     require_not_null(ch);
 
     int error = pthread_mutex_lock(&ch->mutex);
     panic_if(error != 0, "error %d", error);
 
-    int len = vqueue_len(ch->queue);
+    long int len = vqueue_len(ch->queue);
 
     error = pthread_mutex_unlock(&ch->mutex);
     panic_if(error != 0, "error %d", error);
@@ -255,19 +378,22 @@ int uchan_len(UChan* ch) {
 bool uchan_receive2_noblock(UChan* ch, /*out*/void** x) {
     require_not_null(ch);
     require_not_null(x);
+    require("pointer channel", ch->queue->elem_size == sizeof(void*));
 
     int error = pthread_mutex_lock(&ch->mutex);
     panic_if(error != 0, "error %d", error);
 
     bool has_value = !vqueue_empty(ch->queue);
+    VQueueBlock* retired = NULL;
     if (has_value) {
-        *x = vqueue_get(ch->queue);
+        *x = vqueue_get_deferred(ch->queue, &retired);
     } else {
         *x = NULL;
     }
 
     error = pthread_mutex_unlock(&ch->mutex);
     panic_if(error != 0, "error %d", error);
+    vqueue_free_blocks(retired);
 
     return has_value;
 }
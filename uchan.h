@@ -11,12 +11,17 @@
 typedef struct UChan UChan;
 
 UChan* uchan_new(void);
+UChan* uchan_new_sized(size_t elem_size);
 void uchan_free(UChan* ch);
-int uchan_len(UChan* ch);
+long int uchan_len(UChan* ch);
 void uchan_close(UChan* ch);
 
 void uchan_send(UChan* ch, void* x);
 void* uchan_receive(UChan* ch);
+void uchan_send_n(UChan* ch, const void* xs, long int n);
+long int uchan_receive_n(UChan* ch, void* xs, long int n);
+void uchan_send_elem(UChan* ch, const void* x);
+bool uchan_receive2_elem(UChan* ch, void* x);
 void uchan_send_int(UChan* ch, int x);
 int uchan_receive_int(UChan* ch);
 
@@ -26,4 +31,24 @@ bool uchan_receive2_noblock(UChan* ch, void** x);
 
 int uchan_select(UChan** channels, int n_channels, void** x, bool* has_value);
 
+/*
+Generates functions for a channel of values of type T, which are stored in the
+channel by value:
+
+    generate_uchan(Point, pch_)
+
+defines UChan* pch_new(void), void pch_send(UChan* ch, Point x), and bool
+pch_receive2(UChan* ch, Point* x).
+*/
+#define generate_uchan(T, func_prefix)\
+static inline UChan* func_prefix##new(void) {\
+    return uchan_new_sized(sizeof(T));\
+}\
+static inline void func_prefix##send(UChan* ch, T x) {\
+    uchan_send_elem(ch, &x);\
+}\
+static inline bool func_prefix##receive2(UChan* ch, T* x) {\
+    return uchan_receive2_elem(ch, x);\
+}
+
 #endif // uchan_h_INCLUDED
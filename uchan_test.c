@@ -3,6 +3,13 @@
 
 _Static_assert(sizeof(void*) == sizeof(pthread_t), "valid size");
 
+typedef struct {
+    long int low, high;
+    int depth;
+} Task;
+
+generate_uchan(Task, task_chan_)
+
 typedef struct {
     UChan* ch;
     int i;
@@ -86,6 +93,36 @@ int main(void) {
     // join_all(&thread, 1);
     // join_all((pthread_t[]){thread}, 1);
 
+    // bulk send and receive
+    ch = uchan_new();
+    void* xs[2000];
+    for (long int k = 0; k < 2000; k++) xs[k] = (void*)k;
+    uchan_send_n(ch, xs, 2000);
+    uchan_send_int(ch, 2000);
+    void* ys[3000];
+    test_equal_i(uchan_receive_n(ch, ys, 1500) == 1500, true);
+    test_equal_i(uchan_receive_n(ch, ys + 1500, 1500) == 501, true);
+    test_equal_i(forall(k, 2001, (long int)ys[k] == k), true);
+    uchan_close(ch);
+    test_equal_i(uchan_receive_n(ch, ys, 10) == 0, true);
+    uchan_free(ch);
+
+    // structs by value
+    ch = task_chan_new();
+    for (int k = 0; k < 1000; k++) task_chan_send(ch, (Task){k, 2 * k, k % 7});
+    uchan_close(ch);
+    Task t;
+    bool ok = true;
+    int n_tasks = 0;
+    while (task_chan_receive2(ch, &t)) {
+        ok &= t.low == n_tasks && t.high == 2 * n_tasks && t.depth == n_tasks % 7;
+        n_tasks++;
+    }
+    test_equal_i(ok, true);
+    test_equal_i(n_tasks, 1000);
+    test_equal_i(t.low == 0 && t.high == 0 && t.depth == 0, true);
+    uchan_free(ch);
+
     stderr_log("main end");
     return 0;
 }
@@ -1,5 +1,36 @@
 /*
-VQueue is a vector-based queue that automatically grows and shrinks as necessary.
+VQueue is an unbounded queue that grows and shrinks as necessary. The items
+have a fixed size that is given when the queue is created, a pointer by default.
+They are stored by value in fixed-size blocks of VQUEUE_BLOCK_SIZE items, which form a linked list
+from the head block (oldest items) to the tail block (newest items). A put that
+finds the tail block full appends a new block, and a get that has consumed the
+head block releases it. Both take constant time, so the queue never copies its
+items, and a long queue does not cause a pause when it grows or shrinks.
+Released blocks are kept in a cache of up to VQUEUE_CACHE_BLOCKS blocks, so a
+queue whose length oscillates around a block boundary does not call malloc and
+free all the time.
+
+The head and tail are counts of the items taken and put so far. As the block
+size is a power of two, the position within a block is the count masked with
+VQUEUE_BLOCK_MASK, and a count whose position is 0 marks a block boundary. Only
+at a boundary does a put or get need to touch the block list, so the common case
+is a short inline function in vqueue.h, which the compiler can fold into the
+channel code, and the block changes are out of line in this file.
+
+Blocks can also be allocated and freed by the caller, outside of a lock that
+protects the queue: vqueue_new_block allocates a block that vqueue_add_block
+hands to the queue, which a following put then uses instead of calling malloc.
+vqueue_get_deferred returns the blocks that do not fit into the cache instead of
+freeing them, so that the caller can free them with vqueue_free_blocks after
+unlocking.
+
+vqueue_put_n, vqueue_get_n, and vqueue_drain_into move many items at once, with
+one memcpy per block that they touch.
+
+Storing the items by value avoids allocating a box for each item that is not a
+pointer, e.g., a small struct, and the items of a block are contiguous in memory
+for streaming. generate_vqueue in vqueue.h defines typed wrappers, whose item
+size is a constant, so the compiler can inline the copy of an item.
 
 @author: Michael Rohs
 @date: January 5, 2023
@@ -13,100 +44,185 @@ VQueue is a vector-based queue that automatically grows and shrinks as necessary
 
 #include "vqueue.h"
 
-// Initial capacity (number of items).
-#define INITIAL_CAP 512
-
-struct VQueue {
-    int cap; // capacity of the data array (maximum number of items)
-    int len; // number of items in the queue
-    int head; // next position to read
-    int tail; // next position to write
-    void** data; // points to an array of void*
-};
-
-VQueue* vqueue_new(void) {
+// Creates a queue of items of elem_size bytes.
+VQueue* vqueue_new_sized(size_t elem_size) {
+    require("positive", elem_size > 0);
     VQueue* q = xcalloc(1, sizeof(VQueue));
-    q->cap = INITIAL_CAP;
-    q->data = xmalloc(INITIAL_CAP * sizeof(void*));
+    q->elem_size = elem_size;
+    // the block for the first put
+    vqueue_add_block(q, vqueue_new_block(q));
     return q;
 }
 
+// Creates a queue of pointers.
+VQueue* vqueue_new(void) {
+    return vqueue_new_sized(sizeof(void*));
+}
+
+// Allocates a block for vqueue_add_block. Does not access the mutable state of
+// q, so it needs no lock.
+VQueueBlock* vqueue_new_block(VQueue* q) {
+    require_not_null(q);
+    VQueueBlock* b = xmalloc(sizeof(VQueueBlock) + VQUEUE_BLOCK_SIZE * q->elem_size);
+    b->next = NULL;
+    return b;
+}
+
+// Frees a list of blocks, e.g., from vqueue_get_deferred.
+void vqueue_free_blocks(VQueueBlock* b) {
+    while (b != NULL) {
+        VQueueBlock* next = b->next;
+        free(b);
+        b = next;
+    }
+}
+
 void vqueue_free(VQueue* q) {
     require_not_null(q);
-    free(q->data);
+    vqueue_free_blocks(q->head_block);
+    vqueue_free_blocks(q->cache);
     free(q);
 }
 
-// Enqueues x in q. x == NULL is allowed.
-void vqueue_put(VQueue* q, void* x) {
-    require_not_null(q);
-    if (q->len == q->cap) {
-        int n = q->cap;
-        int h = q->head;
-        int t = q->tail;
-        // stderr_log("cap=%d h=%d t=%d", n, h, t);
-        assert("head index equals tail index", h == t);
-        int cap_new = 2 * n;
-        void** new = xmalloc(cap_new * sizeof(void*));
-        // |*******************|
-        //        h            n
-        //        t            n
-        memcpy(new, q->data + h, (n - h) * sizeof(void*));
-        memcpy(new + (n - h), q->data, t * sizeof(void*));
-        free(q->data);
-        q->cap = cap_new;
-        q->head = 0;
-        q->tail = n;
-        q->data = new;
+// Returns a cached block, or a new block if the cache is empty.
+static VQueueBlock* take_block(VQueue* q) {
+    VQueueBlock* b = q->cache;
+    if (b != NULL) {
+        q->cache = b->next;
+        q->n_cached--;
+    } else {
+        b = vqueue_new_block(q);
+    }
+    b->next = NULL;
+    return b;
+}
+
+// Puts a block that is no longer used into the cache, or onto the retired list
+// if the cache is full.
+static void release_block(VQueue* q, VQueueBlock* b, VQueueBlock** retired) {
+    if (q->n_cached >= VQUEUE_CACHE_BLOCKS) {
+        b->next = *retired;
+        *retired = b;
+        return;
     }
-    q->data[q->tail] = x;
-    q->len++;
-    q->tail = (q->tail + 1) % q->cap;
+    b->next = q->cache;
+    q->cache = b;
+    q->n_cached++;
 }
 
-// Dequeues and returns a value from q. Q must not be empty.
-void* vqueue_get(VQueue* q) {
+// Returns the number of blocks that putting n items into q would allocate,
+// i.e., those that neither the tail block nor the cache can provide.
+long int vqueue_blocks_needed(VQueue* q, long int n) {
     require_not_null(q);
-    require("not empty", !vqueue_empty(q));
-    void* x = q->data[q->head];
-    q->len--;
-    q->head = (q->head + 1) % q->cap;
-    if (q->cap > INITIAL_CAP && q->len < q->cap / 4) {
-        int n = q->cap;
-        int h = q->head;
-        int t = q->tail;
-        // stderr_log("cap=%d len=%d h=%d t=%d", n, q->len, h, t);
-        int cap_new = n / 2;
-        if (cap_new < INITIAL_CAP) cap_new = INITIAL_CAP;
-        void** new = xmalloc(cap_new * sizeof(void*));
-        if (h <= t) {
-            // |---********--------|
-            //     h       t       n
-            memcpy(new, q->data + h, (t - h) * sizeof(void*));
-        } else {
-            // |******        *****|
-            //        t       h    n
-            memcpy(new, q->data + h, (n - h) * sizeof(void*));
-            memcpy(new + (n - h), q->data, t * sizeof(void*));
-        }
-        free(q->data);
-        q->cap = cap_new;
-        q->head = 0;
-        q->tail = q->len;
-        q->data = new;
+    require("not negative", n >= 0);
+    long int i = q->tail & VQUEUE_BLOCK_MASK;
+    long int room = i == 0 ? 0 : VQUEUE_BLOCK_SIZE - i;
+    if (n <= room) return 0;
+    long int blocks = (n - room + VQUEUE_BLOCK_SIZE - 1) / VQUEUE_BLOCK_SIZE - q->n_cached;
+    return blocks > 0 ? blocks : 0;
+}
+
+// Checks whether the next put needs a new block, i.e., whether the tail block is
+// full and the cache is empty.
+bool vqueue_needs_block(VQueue* q) {
+    require_not_null(q);
+    return (q->tail & VQUEUE_BLOCK_MASK) == 0 && q->cache == NULL;
+}
+
+// Adds the block b from vqueue_new_block to the cache of q.
+void vqueue_add_block(VQueue* q, VQueueBlock* b) {
+    require_not_null(q);
+    require_not_null(b);
+    b->next = q->cache;
+    q->cache = b;
+    q->n_cached++;
+}
+
+// Appends a new tail block.
+static void append_block(VQueue* q) {
+    VQueueBlock* b = take_block(q);
+    if (q->tail_block != NULL) q->tail_block->next = b;
+    else q->head_block = b;
+    q->tail_block = b;
+}
+
+// Enqueues x at the beginning of a new tail block. Called by vqueue_put at a
+// block boundary.
+void vqueue_put_block(VQueue* q, const void* x) {
+    require_not_null(q);
+    require("at block boundary", (q->tail & VQUEUE_BLOCK_MASK) == 0);
+    append_block(q);
+    memcpy(q->tail_block->data, x, q->elem_size);
+    q->tail++;
+}
+
+// Releases the head block, whose items have all been taken. Called by
+// vqueue_get at a block boundary.
+void vqueue_next_block(VQueue* q, VQueueBlock** retired) {
+    require_not_null(q);
+    require("at block boundary", (q->head & VQUEUE_BLOCK_MASK) == 0);
+    VQueueBlock* b = q->head_block;
+    q->head_block = b->next;
+    if (q->head_block == NULL) {
+        assert("empty", q->head == q->tail);
+        q->tail_block = NULL;
     }
-    return x;
+    release_block(q, b, retired);
 }
 
-// Checks whether q is empty.
-bool vqueue_empty(VQueue* q) {
+// Enqueues the n items of the array xs in q, in order.
+void vqueue_put_n(VQueue* q, const void* xs, long int n) {
     require_not_null(q);
-    return q->len <= 0;
+    require("valid items", xs != NULL || n == 0);
+    require("not negative", n >= 0);
+    size_t size = q->elem_size;
+    const char* p = xs;
+    while (n > 0) {
+        long int i = q->tail & VQUEUE_BLOCK_MASK;
+        if (i == 0) append_block(q);
+        long int m = VQUEUE_BLOCK_SIZE - i < n ? VQUEUE_BLOCK_SIZE - i : n;
+        memcpy(q->tail_block->data + i * size, p, m * size);
+        q->tail += m;
+        p += m * size;
+        n -= m;
+    }
 }
 
-// Returns the number of items in q.
-int vqueue_len(VQueue* q) {
+// Dequeues up to n items from q into the array xs, in order, and returns their
+// number. A block that is released and does not fit into the cache is put onto
+// the list *retired instead of being freed.
+long int vqueue_get_n_deferred(VQueue* q, void* xs, long int n, VQueueBlock** retired) {
     require_not_null(q);
-    return q->len;
+    require("valid items", xs != NULL || n == 0);
+    require("not negative", n >= 0);
+    require_not_null(retired);
+    if (n > vqueue_len(q)) n = vqueue_len(q);
+    size_t size = q->elem_size;
+    char* p = xs;
+    long int done = 0;
+    while (done < n) {
+        long int i = q->head & VQUEUE_BLOCK_MASK;
+        long int m = VQUEUE_BLOCK_SIZE - i < n - done ? VQUEUE_BLOCK_SIZE - i : n - done;
+        memcpy(p + done * size, q->head_block->data + i * size, m * size);
+        q->head += m;
+        done += m;
+        if ((q->head & VQUEUE_BLOCK_MASK) == 0) vqueue_next_block(q, retired);
+    }
+    return n;
+}
+
+// Dequeues up to n items from q into the array xs, in order, and returns their
+// number.
+long int vqueue_get_n(VQueue* q, void* xs, long int n) {
+    VQueueBlock* retired = NULL;
+    n = vqueue_get_n_deferred(q, xs, n, &retired);
+    vqueue_free_blocks(retired);
+    return n;
 }
 
+// Dequeues all items from q into xs, which must have room for vqueue_len(q)
+// items, and returns their number.
+long int vqueue_drain_into(VQueue* q, void* xs) {
+    require_not_null(q);
+    return vqueue_get_n(q, xs, vqueue_len(q));
+}
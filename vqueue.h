@@ -6,15 +6,153 @@
 #ifndef vqueue_h_INCLUDED
 #define vqueue_h_INCLUDED
 
+#include <stddef.h>
 #include "util.h"
 
+// Number of items per block, a power of two.
+#define VQUEUE_LOG_BLOCK_SIZE 9
+#define VQUEUE_BLOCK_SIZE (1 << VQUEUE_LOG_BLOCK_SIZE)
+#define VQUEUE_BLOCK_MASK (VQUEUE_BLOCK_SIZE - 1)
+
+// Maximum number of free blocks that are kept for reuse.
+#define VQUEUE_CACHE_BLOCKS 4
+
+typedef struct VQueueBlock VQueueBlock;
+struct VQueueBlock {
+    VQueueBlock* next; // next newer block, or next cached block
+    _Alignas(max_align_t) char data[]; // VQUEUE_BLOCK_SIZE items of elem_size bytes
+};
+
+// The fields are public only for the inline functions below.
 typedef struct VQueue VQueue;
+struct VQueue {
+    long int head; // number of items taken so far, reads at head & VQUEUE_BLOCK_MASK
+    long int tail; // number of items put so far, writes at tail & VQUEUE_BLOCK_MASK
+    size_t elem_size; // size of an item in bytes, does not change
+    VQueueBlock* head_block; // oldest block, NULL if there are no blocks
+    VQueueBlock* tail_block; // newest block, NULL if there are no blocks
+    VQueueBlock* cache; // free blocks
+    int n_cached; // number of free blocks
+};
 
 VQueue* vqueue_new(void);
+VQueue* vqueue_new_sized(size_t elem_size);
 void vqueue_free(VQueue* q);
-void vqueue_put(VQueue* q, void* x);
-void* vqueue_get(VQueue* q);
-bool vqueue_empty(VQueue* q);
-int vqueue_len(VQueue* q);
+void vqueue_put_block(VQueue* q, const void* x);
+void vqueue_next_block(VQueue* q, VQueueBlock** retired);
+bool vqueue_needs_block(VQueue* q);
+long int vqueue_blocks_needed(VQueue* q, long int n);
+VQueueBlock* vqueue_new_block(VQueue* q);
+void vqueue_add_block(VQueue* q, VQueueBlock* b);
+void vqueue_free_blocks(VQueueBlock* b);
+void vqueue_put_n(VQueue* q, const void* xs, long int n);
+long int vqueue_get_n(VQueue* q, void* xs, long int n);
+long int vqueue_get_n_deferred(VQueue* q, void* xs, long int n, VQueueBlock** retired);
+long int vqueue_drain_into(VQueue* q, void* xs);
+
+// Checks whether q is empty.
+static inline bool vqueue_empty(VQueue* q) {
+    return q->head == q->tail;
+}
+
+// Returns the number of items in q.
+static inline long int vqueue_len(VQueue* q) {
+    return q->tail - q->head;
+}
+
+// Enqueues the item of size bytes at x in q. size must equal the queue's item
+// size. If it is a constant, the copy is inlined.
+__attribute__((always_inline))
+static inline void vqueue_put_sized(VQueue* q, const void* x, size_t size) {
+    require("valid size", size == q->elem_size);
+    long int i = q->tail & VQUEUE_BLOCK_MASK;
+    if (i == 0) {
+        // the tail block is full, or there is none
+        vqueue_put_block(q, x);
+        return;
+    }
+    memcpy(q->tail_block->data + i * size, x, size);
+    q->tail++;
+}
+
+// Dequeues an item of size bytes from q into x, like vqueue_put_sized. Q must not
+// be empty. A block that is released and does not fit into the cache is put onto
+// the list *retired instead of being freed.
+__attribute__((always_inline))
+static inline void vqueue_get_sized(VQueue* q, void* x, size_t size, VQueueBlock** retired) {
+    require("valid size", size == q->elem_size);
+    require("not empty", !vqueue_empty(q));
+    memcpy(x, q->head_block->data + (q->head & VQUEUE_BLOCK_MASK) * size, size);
+    q->head++;
+    if ((q->head & VQUEUE_BLOCK_MASK) == 0) vqueue_next_block(q, retired);
+}
+
+// Enqueues the item at x in q.
+static inline void vqueue_put_elem(VQueue* q, const void* x) {
+    vqueue_put_sized(q, x, q->elem_size);
+}
+
+// Dequeues an item from q into x. Q must not be empty. A block that is released
+// and does not fit into the cache is put onto the list *retired instead of being
+// freed.
+static inline void vqueue_get_elem_deferred(VQueue* q, void* x, VQueueBlock** retired) {
+    vqueue_get_sized(q, x, q->elem_size, retired);
+}
+
+// Enqueues x in q, which must be a queue of pointers. x == NULL is allowed.
+static inline void vqueue_put(VQueue* q, void* x) {
+    vqueue_put_sized(q, &x, sizeof(void*));
+}
+
+// Dequeues and returns a value from q, which must be a queue of pointers, like
+// vqueue_get_elem_deferred.
+static inline void* vqueue_get_deferred(VQueue* q, VQueueBlock** retired) {
+    void* x;
+    vqueue_get_sized(q, &x, sizeof(void*), retired);
+    return x;
+}
+
+// Dequeues and returns a value from q, which must be a queue of pointers. Q must
+// not be empty.
+static inline void* vqueue_get(VQueue* q) {
+    VQueueBlock* retired = NULL;
+    void* x = vqueue_get_deferred(q, &retired);
+    if (retired != NULL) vqueue_free_blocks(retired);
+    return x;
+}
+
+/*
+Generates a queue for items of type T that are stored in the blocks themselves,
+without a pointer per item:
+
+    generate_vqueue(PointQueue, Point, pq_)
+
+defines PointQueue* pq_new(void), void pq_put(PointQueue* q, Point x), Point
+pq_get(PointQueue* q), as well as pq_free, pq_empty, and pq_len.
+*/
+#define generate_vqueue(QueueType, T, func_prefix)\
+typedef VQueue QueueType;\
+static inline QueueType* func_prefix##new(void) {\
+    return vqueue_new_sized(sizeof(T));\
+}\
+static inline void func_prefix##free(QueueType* q) {\
+    vqueue_free(q);\
+}\
+static inline void func_prefix##put(QueueType* q, T x) {\
+    vqueue_put_sized(q, &x, sizeof(T));\
+}\
+static inline T func_prefix##get(QueueType* q) {\
+    T x;\
+    VQueueBlock* retired = NULL;\
+    vqueue_get_sized(q, &x, sizeof(T), &retired);\
+    if (retired != NULL) vqueue_free_blocks(retired);\
+    return x;\
+}\
+static inline bool func_prefix##empty(QueueType* q) {\
+    return vqueue_empty(q);\
+}\
+static inline long int func_prefix##len(QueueType* q) {\
+    return vqueue_len(q);\
+}
 
 #endif // vqueue_h_INCLUDED
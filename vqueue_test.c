@@ -0,0 +1,183 @@
+#include "vqueue.h"
+
+typedef struct {
+    long int id;
+    double x, y;
+    char tag[4];
+} Item;
+
+generate_vqueue(ItemQueue, Item, item_queue_)
+
+// Puts and gets items in a pattern that makes the queue grow over many blocks,
+// shrink, and grow again, and checks that the items come out in order.
+void test_fifo(void) {
+    VQueue* q = vqueue_new();
+    test_equal_i(vqueue_empty(q), true);
+    long int next_put = 0, next_get = 0;
+    bool ok = true;
+    int sizes[] = {1, 511, 512, 513, 100000, 3, 2000, 0, 70000};
+    for (int r = 0; r < sizeof(sizes) / sizeof(sizes[0]); r++) {
+        // grow to sizes[r] items, then remove half of them
+        while (vqueue_len(q) < sizes[r]) vqueue_put(q, (void*)next_put++);
+        ok &= vqueue_len(q) == next_put - next_get;
+        long int n = vqueue_len(q) / 2;
+        for (long int i = 0; i < n; i++) ok &= (long int)vqueue_get(q) == next_get++;
+    }
+    while (!vqueue_empty(q)) ok &= (long int)vqueue_get(q) == next_get++;
+    test_equal_i(ok, true);
+    test_equal_i(next_get == next_put, true);
+    test_equal_i(vqueue_len(q) == 0, true);
+
+    // alternating put and get around a block boundary
+    for (long int i = 0; i < 5000; i++) {
+        vqueue_put(q, (void*)i);
+        vqueue_put(q, NULL);
+        ok &= (long int)vqueue_get(q) == i && vqueue_get(q) == NULL;
+    }
+    test_equal_i(ok, true);
+    test_equal_i(vqueue_empty(q), true);
+    vqueue_free(q);
+}
+
+// Supplies the blocks from outside and frees the released blocks outside, as
+// the channel does.
+void test_deferred(void) {
+    VQueue* q = vqueue_new();
+    long int n = 100000;
+    int n_added = 0;
+    bool ok = true;
+    for (long int i = 0; i < n; i++) {
+        if (vqueue_needs_block(q)) {
+            vqueue_add_block(q, vqueue_new_block(q));
+            n_added++;
+        }
+        ok &= !vqueue_needs_block(q);
+        vqueue_put(q, (void*)i);
+    }
+    test_equal_i(ok, true);
+    test_equal_i(n_added, (n - 1) / 512);
+    VQueueBlock* retired = NULL;
+    for (long int i = 0; i < n; i++) ok &= (long int)vqueue_get_deferred(q, &retired) == i;
+    test_equal_i(ok, true);
+    int n_retired = 0;
+    // the link to the next block is the first member of a block
+    for (VQueueBlock* b = retired; b != NULL; b = *(VQueueBlock**)b) n_retired++;
+    // all but the last block are released, and the cache keeps 4 of them
+    test_equal_i(n_retired, n_added - 4);
+    vqueue_free_blocks(retired);
+    vqueue_free(q);
+}
+
+// Moves items in and out in bulk, in amounts that cross block boundaries, mixed
+// with single puts and gets.
+void test_bulk(void) {
+    VQueue* q = vqueue_new();
+    long int n = 5000;
+    void** in = xmalloc(n * sizeof(void*));
+    void** out = xmalloc(n * sizeof(void*));
+    for (long int i = 0; i < n; i++) in[i] = (void*)i;
+    long int amounts[] = {0, 1, 511, 512, 513, 1024, 3000, 7};
+    long int next_put = 0, next_get = 0;
+    bool ok = true;
+    for (int r = 0; r < sizeof(amounts) / sizeof(amounts[0]); r++) {
+        long int a = amounts[r];
+        for (long int i = 0; i < a; i++) in[i] = (void*)(next_put + i);
+        vqueue_put_n(q, in, a);
+        next_put += a;
+        vqueue_put(q, (void*)next_put++);
+        ok &= vqueue_len(q) == next_put - next_get;
+        long int m = vqueue_get_n(q, out, a / 2 + 1);
+        ok &= m == a / 2 + 1;
+        for (long int i = 0; i < m; i++) ok &= (long int)out[i] == next_get++;
+        if (!vqueue_empty(q)) ok &= (long int)vqueue_get(q) == next_get++;
+    }
+    test_equal_i(ok, true);
+    long int len = vqueue_len(q);
+    test_equal_i(vqueue_get_n(q, out, n) == len, true);
+    for (long int i = 0; i < len; i++) ok &= (long int)out[i] == next_get++;
+    test_equal_i(ok, true);
+    test_equal_i(next_get == next_put, true);
+    test_equal_i(vqueue_get_n(q, out, 10) == 0, true);
+
+    for (long int i = 0; i < n; i++) in[i] = (void*)i;
+    vqueue_put_n(q, in, n);
+    test_equal_i(vqueue_drain_into(q, out) == n, true);
+    test_equal_i(memcmp(in, out, n * sizeof(void*)), 0);
+    test_equal_i(vqueue_empty(q), true);
+    free(out);
+    free(in);
+    vqueue_free(q);
+}
+
+// Stores structs by value, one at a time and in bulk.
+void test_sized(void) {
+    ItemQueue* q = item_queue_new();
+    long int n = 3000;
+    bool ok = true;
+    for (long int i = 0; i < n; i++) item_queue_put(q, (Item){i, i * 0.5, -i, "abc"});
+    test_equal_i(item_queue_len(q) == n, true);
+    for (long int i = 0; i < n / 2; i++) {
+        Item it = item_queue_get(q);
+        ok &= it.id == i && it.x == i * 0.5 && it.y == -i && strcmp(it.tag, "abc") == 0;
+    }
+    test_equal_i(ok, true);
+    Item* items = xmalloc(2 * n * sizeof(Item));
+    for (long int i = 0; i < n; i++) items[i] = (Item){n + i, 0, 0, "xyz"};
+    vqueue_put_n(q, items, n);
+    long int m = vqueue_drain_into(q, items);
+    test_equal_i(m == n + n / 2, true);
+    for (long int i = 0; i < m; i++) ok &= items[i].id == n / 2 + i;
+    test_equal_i(ok, true);
+    test_equal_i(item_queue_empty(q), true);
+    free(items);
+    item_queue_free(q);
+}
+
+// Measures the throughput of put and get, once for a queue that grows to n
+// items and is then drained, and once for a queue that stays at 1000 items.
+// Reports the best of several runs in nanoseconds per operation.
+void benchmark(long int n) {
+    double best[2] = {0, 0};
+    for (int r = 0; r < 5; r++) {
+        VQueue* q = vqueue_new();
+        long int sum = 0;
+        timespec start = time_now();
+        for (long int i = 0; i < n; i++) vqueue_put(q, (void*)i);
+        for (long int i = 0; i < n; i++) sum += (long int)vqueue_get(q);
+        double ms = time_ms_since(start);
+        if (r == 0 || ms < best[0]) best[0] = ms;
+
+        for (long int i = 0; i < 1000; i++) vqueue_put(q, (void*)i);
+        start = time_now();
+        for (long int i = 0; i < n; i++) {
+            vqueue_put(q, (void*)i);
+            sum += (long int)vqueue_get(q);
+        }
+        ms = time_ms_since(start);
+        if (r == 0 || ms < best[1]) best[1] = ms;
+        panic_if(sum < 0, "overflow");
+        vqueue_free(q);
+    }
+    printf("n = %ld\n", n);
+    printf("%10s %12s\n", "pattern", "ns/op");
+    printf("%10s %12.2f\n", "fill", best[0] * 1e6 / (2 * n));
+    printf("%10s %12.2f\n", "steady", best[1] * 1e6 / (2 * n));
+}
+
+// Without arguments, runs the tests. Otherwise measures the throughput of put
+// and get:
+//
+//     vqueue_test bench [n]
+int main(int argc, char* argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+        long int n = argc >= 3 ? atol(argv[2]) : 10000000;
+        exit_if(n <= 0, "usage: vqueue_test bench [n]");
+        benchmark(n);
+        return 0;
+    }
+    test_fifo();
+    test_deferred();
+    test_bulk();
+    test_sized();
+    return 0;
+}